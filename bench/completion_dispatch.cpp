@@ -0,0 +1,135 @@
+/*
+	Checks fence_pool and completion_dispatcher against a real device: released fences come back unsignaled instead of
+	new ones being created, signaled ones included; every watched submit gets its continuation exactly once, with
+	VK_SUCCESS and on the dispatcher thread, and its pooled fence back in the pool; a continuation waits for its fence
+	however long the submit is held up; and destroying the dispatcher runs what it still watches. Holding a submit up
+	needs VK_KHR_timeline_semaphore, that check is skipped without it. Exits with 1 if any check fails.
+*/
+
+#include "vulkanomics.hpp"
+
+#include <cstdio>
+
+static int failures = 0;
+
+static void check(bool ok, char const * what) {
+	printf("%s: %s\n", ok ? "ok" : "FAILED", what);
+	if (!ok) failures++;
+}
+
+static constexpr uint32_t submits = 16;
+
+static void submit(vk::queue_accessor & queue, VkFence f) {
+	VkSubmitInfo submit_info = {
+		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+		.pNext = nullptr,
+		.waitSemaphoreCount = 0,
+		.pWaitSemaphores = nullptr,
+		.pWaitDstStageMask = nullptr,
+		.commandBufferCount = 0,
+		.pCommandBuffers = nullptr,
+		.signalSemaphoreCount = 0,
+		.pSignalSemaphores = nullptr,
+	};
+	queue.submit(&submit_info, 1, f);
+}
+
+//false if the dispatcher does not get there within a few seconds
+static bool drained(vk::completion_dispatcher const & dispatcher) {
+	auto give_up = std::chrono::steady_clock::now() + std::chrono::seconds {5};
+	while (dispatcher.outstanding()) {
+		if (std::chrono::steady_clock::now() > give_up) return false;
+		std::this_thread::sleep_for(std::chrono::milliseconds {1});
+	}
+	return true;
+}
+
+static void pool_reuse(vk::device & dev, vk::queue_accessor & queue) {
+	vk::fence_pool pool {dev};
+	std::vector<vk::fence *> taken;
+	for (uint32_t i = 0; i < 4; i++) taken.push_back(&pool.acquire());
+	check(pool.size() == 4, "an empty pool creates a fence per acquire");
+
+	submit(queue, *taken[0]);
+	taken[0]->wait();
+	for (vk::fence * f : taken) pool.release(*f);
+	bool unsignaled = true;
+	for (uint32_t i = 0; i < 4; i++) unsignaled &= !pool.acquire().signaled();
+	check(pool.size() == 4 && unsignaled, "released fences are reused, the signaled one reset");
+}
+
+static void dispatch(vk::device & dev, vk::queue_accessor & queue) {
+	vk::fence_pool pool {dev};
+	std::atomic<uint32_t> ran[submits] = {}, succeeded {0};
+	std::atomic_bool on_dispatcher {true};
+	std::thread::id caller = std::this_thread::get_id();
+	{
+		vk::completion_dispatcher dispatcher {dev, pool};
+		for (uint32_t i = 0; i < submits; i++) {
+			vk::fence & f = pool.acquire();
+			submit(queue, f);
+			dispatcher.watch(f, [&, i](VkResult res){
+				ran[i]++;
+				if (res == VK_SUCCESS) succeeded++;
+				if (std::this_thread::get_id() == caller) on_dispatcher = false;
+			});
+		}
+		check(drained(dispatcher), "every watched fence completes");
+		bool once = true;
+		for (std::atomic<uint32_t> const & r : ran) once &= r == 1;
+		check(once && succeeded == submits && on_dispatcher, "each continuation runs once, with VK_SUCCESS, on the dispatcher thread");
+
+		size_t created = pool.size();
+		std::vector<vk::fence *> again;
+		for (uint32_t i = 0; i < created; i++) again.push_back(&pool.acquire());
+		check(pool.size() == created, "pooled fences are released back once their continuation ran");
+		for (vk::fence * f : again) pool.release(*f); //never submitted, reusable as is
+
+		vk::fence & last = pool.acquire();
+		submit(queue, last);
+		dispatcher.watch(last, [&](VkResult){ ran[0]++; });
+	}
+	check(ran[0] == 2, "destroying the dispatcher runs what it still watches");
+}
+
+static void held_up(vk::device & dev, vk::queue_accessor & queue) {
+	if (!dev.vkWaitSemaphoresKHR) {
+		printf("skipped: no VK_KHR_timeline_semaphore to hold up a submit with\n");
+		return;
+	}
+	vk::fence_pool pool {dev};
+	vk::completion_dispatcher dispatcher {dev, pool};
+	vk::timeline_queue tq {dev, queue};
+	vk::timeline_semaphore gate {dev};
+	vk::gpu_future opened = gate.at(1);
+	VkPipelineStageFlags stage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+	vk::fence & f = pool.acquire();
+	tq.submit(nullptr, 0, &opened, &stage, 1, f);
+	std::atomic_bool ran {false};
+	dispatcher.watch(f, [&ran](VkResult){ ran = true; });
+	std::this_thread::sleep_for(std::chrono::milliseconds {20});
+	check(!ran && dispatcher.outstanding() == 1, "a continuation waits while its submit is held up");
+	gate.signal(1);
+	check(drained(dispatcher) && ran, "and runs once the submit is let through");
+}
+
+static void run(vk::device & dev) {
+	vk::queue_accessor_direct queue {dev, 0};
+	pool_reuse(dev, queue);
+	dispatch(dev, queue);
+	held_up(dev, queue);
+}
+
+int main() {
+	vk::instance::init();
+	try {
+		vk::device::initializer init {vk::get_physical_devices().front(), {vk::device::capability::compute}};
+		vk::device dev {init};
+		run(dev);
+	} catch (std::exception & e) {
+		fprintf(stderr, "%s\n", e.what());
+		failures++;
+	}
+	vk::instance::term();
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,110 @@
+/*
+	Checks gpu_executor against a real device, with many request handlers suspended on one worker at once: every
+	handler moves to the worker with schedule(), uploads a value of its own through the staging ring, submits a barrier
+	making it visible to transfer reads, reads it back, and compares. Each awaiter has to resume its handler, on the
+	worker and with the right data, for all of them to finish. The one worker also keeps the staging ring, which is not
+	thread safe, to one thread. Built with --cxx20 only. Exits with 1 if any check fails.
+*/
+
+#include "vulkanomics_coro.hpp"
+
+#include <cstdio>
+#include <cstring>
+
+static int failures = 0;
+
+static void check(bool ok, char const * what) {
+	printf("%s: %s\n", ok ? "ok" : "FAILED", what);
+	if (!ok) failures++;
+}
+
+static constexpr uint32_t handlers = 64;
+
+struct context {
+	vk::gpu_executor & exec;
+	vk::queue_accessor & queue;
+	vk::staging_ring & ring;
+	vk::readback & rb;
+	vk::buffer & target;
+	VkCommandBuffer const & visible; //uploads made visible to transfer reads
+	std::thread::id caller;
+	std::atomic<uint32_t> finished {0}, correct {0}, off_worker {0};
+};
+
+static uint32_t value_of(uint32_t i) {
+	return i * 2654435761u;
+}
+
+static vk::detached_task handle(context & ctx, uint32_t i) {
+	co_await ctx.exec.schedule();
+	if (std::this_thread::get_id() == ctx.caller) ctx.off_worker++;
+	uint32_t value = value_of(i);
+	ctx.ring.upload(ctx.target, i * sizeof(value), &value, sizeof(value));
+	co_await ctx.exec.upload(ctx.ring);
+	if (std::this_thread::get_id() == ctx.caller) ctx.off_worker++;
+
+	VkSubmitInfo submit_info = {
+		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+		.pNext = nullptr,
+		.waitSemaphoreCount = 0,
+		.pWaitSemaphores = nullptr,
+		.pWaitDstStageMask = nullptr,
+		.commandBufferCount = 1,
+		.pCommandBuffers = &ctx.visible,
+		.signalSemaphoreCount = 0,
+		.pSignalSemaphores = nullptr,
+	};
+	co_await ctx.exec.submit(ctx.queue, &submit_info, 1);
+	if (std::this_thread::get_id() == ctx.caller) ctx.off_worker++;
+
+	std::vector<uint8_t> data = co_await ctx.exec.read(ctx.rb, ctx.target, i * sizeof(value), sizeof(value));
+	if (std::this_thread::get_id() == ctx.caller) ctx.off_worker++;
+	uint32_t read = 0;
+	if (data.size() == sizeof(read)) memcpy(&read, data.data(), sizeof(read));
+	if (read == value) ctx.correct++;
+	ctx.finished++;
+}
+
+static void run(vk::device & dev) {
+	vk::queue_accessor_mutexed queue {dev, 0}; //shared by the ring, the readback and the handlers
+	vk::memory_heap heap {dev};
+	vk::buffer target {dev, handlers * sizeof(uint32_t), VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT};
+	heap.bind(target, vk::memory_profile::gpu_only);
+	vk::staging_ring ring {dev, queue, 1 << 16};
+	vk::readback rb {dev, queue, 1 << 16};
+
+	vk::command::pool pool {dev, 0, queue.queue_family};
+	vk::command::buffer visible {pool};
+	visible.begin(VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT); //in flight for several handlers at once
+	VkMemoryBarrier mb = {VK_STRUCTURE_TYPE_MEMORY_BARRIER, nullptr, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT};
+	visible.barrier(VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, &mb, 1, nullptr, 0, nullptr, 0);
+	visible.end();
+
+	vk::gpu_executor exec {dev, 1};
+	context ctx {exec, queue, ring, rb, target, visible.handle, std::this_thread::get_id()};
+	for (uint32_t i = 0; i < handlers; i++) handle(ctx, i);
+
+	auto give_up = std::chrono::steady_clock::now() + std::chrono::seconds {10};
+	while (ctx.finished < handlers && std::chrono::steady_clock::now() < give_up) std::this_thread::sleep_for(std::chrono::milliseconds {1});
+	check(ctx.finished == handlers, "every handler is resumed through to its end");
+	check(ctx.correct == handlers, "every handler reads back what it uploaded");
+	check(ctx.off_worker == 0, "handlers are only resumed on the executor's worker");
+	if (ctx.finished < handlers) {
+		fprintf(stderr, "handlers still suspended, not tearing down under them\n");
+		exit(1);
+	}
+}
+
+int main() {
+	vk::instance::init();
+	try {
+		vk::device::initializer init {vk::get_physical_devices().front(), {vk::device::capability::compute}};
+		vk::device dev {init};
+		run(dev);
+	} catch (std::exception & e) {
+		fprintf(stderr, "%s\n", e.what());
+		failures++;
+	}
+	vk::instance::term();
+	return failures ? 1 : 0;
+}
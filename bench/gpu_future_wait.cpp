@@ -0,0 +1,89 @@
+/*
+	Checks gpu_future against a real device: a future without a timeline is complete; a future is ready exactly once
+	its timeline reaches the value, whether the host or a queue signals it, and a wait with a timeout gives up before
+	that; one host wait over several futures wants all of them or any one; and timeline_queue hands out increasing
+	values whose futures complete with their submits, including a submit waiting on a timeline the host signals later.
+	Skipped without VK_KHR_timeline_semaphore. Exits with 1 if any check fails.
+*/
+
+#include "vulkanomics.hpp"
+
+#include <cstdio>
+
+static int failures = 0;
+
+static void check(bool ok, char const * what) {
+	printf("%s: %s\n", ok ? "ok" : "FAILED", what);
+	if (!ok) failures++;
+}
+
+static void host_signaled(vk::device & dev) {
+	vk::gpu_future none;
+	check(none.ready() && none.wait(0) && vk::gpu_future::wait(&none, 1, false, 0), "a future without a timeline is complete");
+
+	vk::timeline_semaphore timeline {dev, 5};
+	check(timeline.value() == 5 && timeline.at(5).ready() && !timeline.at(6).ready(), "a future is ready once the counter reaches its value");
+	check(!timeline.at(6).wait(0) && !timeline.at(6).wait(1000000), "a wait times out before the value is reached");
+
+	std::thread signaler {[&timeline](){
+		std::this_thread::sleep_for(std::chrono::milliseconds {20});
+		timeline.signal(7);
+	}};
+	bool waited = timeline.at(7).wait();
+	signaler.join();
+	check(waited && timeline.value() == 7 && timeline.at(6).ready(), "a wait returns once another thread signals the value");
+
+	vk::timeline_semaphore a {dev}, b {dev};
+	vk::gpu_future both[2] = {a.at(1), b.at(1)};
+	check(!vk::gpu_future::wait(both, 2, false, 0) && !vk::gpu_future::wait(both, 2, true, 0), "neither all nor any while nothing is signaled");
+	b.signal(1);
+	check(!vk::gpu_future::wait(both, 2, false, 0) && vk::gpu_future::wait(both, 2, true, 0), "any but not all with one signaled");
+	a.signal(1);
+	check(vk::gpu_future::wait(both, 2, false, 0), "all with both signaled");
+
+	vk::timeline_semaphore c {dev};
+	vk::gpu_future mixed[2] = {c.at(1), none};
+	check(vk::gpu_future::wait(mixed, 2, true, 0) && !vk::gpu_future::wait(mixed, 2, false, 0), "a complete future satisfies any, not all");
+}
+
+static void queue_signaled(vk::device & dev) {
+	vk::queue_accessor_direct queue {dev, 0};
+	vk::timeline_queue tq {dev, queue};
+	check(tq.last().value == 0 && tq.last().ready(), "a timeline queue starts out complete");
+
+	vk::gpu_future first = tq.submit(nullptr, 0);
+	check(first.wait() && first.value == 1 && tq.completed() >= 1, "a submit completes its future");
+
+	vk::timeline_semaphore gate {dev};
+	vk::gpu_future opened = gate.at(1);
+	VkPipelineStageFlags stage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+	vk::gpu_future held = tq.submit(nullptr, 0, &opened, &stage, 1);
+	vk::gpu_future after = tq.submit(nullptr, 0);
+	check(held.value == 2 && after.value == 3 && tq.last().value == 3, "values increase with every submit");
+	check(!held.wait(10000000), "a submit waiting on an unsignaled future does not complete");
+	gate.signal(1);
+	check(held.wait() && after.wait() && tq.completed() == 3, "signaling the future lets it through");
+}
+
+static void run(vk::device & dev) {
+	if (!dev.vkWaitSemaphoresKHR) {
+		printf("skipped: no VK_KHR_timeline_semaphore\n");
+		return;
+	}
+	host_signaled(dev);
+	queue_signaled(dev);
+}
+
+int main() {
+	vk::instance::init();
+	try {
+		vk::device::initializer init {vk::get_physical_devices().front(), {vk::device::capability::compute}};
+		vk::device dev {init};
+		run(dev);
+	} catch (std::exception & e) {
+		fprintf(stderr, "%s\n", e.what());
+		failures++;
+	}
+	vk::instance::term();
+	return failures ? 1 : 0;
+}
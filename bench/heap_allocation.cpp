@@ -0,0 +1,103 @@
+/*
+	Binds a few thousand buffers of mixed sizes, first each to a vk::memory of its own and then all through a memory_heap,
+	and prints for both the driver allocations made and the time taken to bind them and to free them again. The number
+	of buffers stays below maxMemoryAllocationCount, which the one allocation per resource path would exceed.
+*/
+
+#include "vulkanomics.hpp"
+
+#include <cstdio>
+
+static constexpr uint32_t resources = 4096;
+
+//64 bytes to 256 KiB, mostly small, like the vertex, index and uniform buffers of a scene
+static VkDeviceSize resource_size(uint32_t i) {
+	return VkDeviceSize {64} << ((i * 7) % 13);
+}
+
+static uint32_t live_allocations(vk::device const & dev) {
+	uint32_t count = 0;
+	for (uint32_t t = 0; t < dev.parent.memory_properties.memoryTypeCount; t++) count += dev.budget.types[t].count.load();
+	return count;
+}
+
+template <typename F> static double milliseconds(F && f) {
+	auto start = std::chrono::steady_clock::now();
+	f();
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+struct measurement {
+	uint32_t allocations;
+	double bind_ms, free_ms;
+};
+
+static std::vector<std::unique_ptr<vk::buffer>> make_buffers(vk::device & dev, uint32_t count) {
+	std::vector<std::unique_ptr<vk::buffer>> bufs;
+	for (uint32_t i = 0; i < count; i++) bufs.emplace_back(new vk::buffer {dev, resource_size(i), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT});
+	return bufs;
+}
+
+static measurement one_per_resource(vk::device & dev, uint32_t count, uint32_t mem_type) {
+	measurement m;
+	std::vector<std::unique_ptr<vk::buffer>> bufs = make_buffers(dev, count);
+	std::vector<std::unique_ptr<vk::memory>> mems;
+	uint32_t before = live_allocations(dev);
+	m.bind_ms = milliseconds([&](){
+		for (std::unique_ptr<vk::buffer> & b : bufs) {
+			mems.emplace_back(new vk::memory {dev, mem_type, b->memory_requirements().size});
+			b->bind_to_memory(0, *mems.back());
+		}
+	});
+	m.allocations = live_allocations(dev) - before;
+	m.free_ms = milliseconds([&](){
+		bufs.clear();
+		mems.clear();
+	});
+	return m;
+}
+
+static measurement heap(vk::device & dev, uint32_t count, uint32_t mem_type) {
+	measurement m;
+	std::vector<std::unique_ptr<vk::buffer>> bufs = make_buffers(dev, count);
+	vk::memory_heap heap {dev};
+	uint32_t before = live_allocations(dev);
+	m.bind_ms = milliseconds([&](){
+		for (std::unique_ptr<vk::buffer> & b : bufs) heap.bind(*b, mem_type);
+	});
+	m.allocations = live_allocations(dev) - before;
+	m.free_ms = milliseconds([&](){
+		bufs.clear();
+	});
+	return m;
+}
+
+static void run(vk::device & dev) {
+	uint32_t count = std::min(resources, dev.parent.properties.limits.maxMemoryAllocationCount - 64);
+	uint32_t mem_type;
+	{
+		vk::buffer probe {dev, resource_size(0), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT};
+		mem_type = dev.parent.find_memory(vk::memory_profile::gpu_only, probe.memory_requirements().memoryTypeBits);
+	}
+	measurement separate = one_per_resource(dev, count, mem_type);
+	measurement pooled = heap(dev, count, mem_type);
+	printf("%u buffers, memory type %u\n", count, mem_type);
+	printf("%-20s %12s %12s %12s\n", "", "allocations", "bind ms", "free ms");
+	printf("%-20s %12u %12.2f %12.2f\n", "one per resource", separate.allocations, separate.bind_ms, separate.free_ms);
+	printf("%-20s %12u %12.2f %12.2f\n", "memory_heap", pooled.allocations, pooled.bind_ms, pooled.free_ms);
+}
+
+int main() {
+	int result = 1;
+	vk::instance::init();
+	try {
+		vk::device::initializer init {vk::get_physical_devices().front(), {vk::device::capability::compute}};
+		vk::device dev {init};
+		run(dev);
+		result = 0;
+	} catch (std::exception & e) {
+		fprintf(stderr, "%s\n", e.what());
+	}
+	vk::instance::term();
+	return result;
+}
@@ -0,0 +1,142 @@
+/*
+	Compares the padding of the multi-resource memory constructor, which reorders its resources, with placing the same
+	resources in the order they are listed, for resource sets modeled on the setup code of a few typical renderers. The
+	listed order keeps linear and optimally tiled neighbors on separate bufferImageGranularity pages too, so both layouts
+	are valid and only the ordering differs.
+*/
+
+#include "vulkanomics.hpp"
+
+#include <cstdio>
+
+struct resource {
+	bool image;
+	VkDeviceSize size; //of a buffer
+	VkBufferUsageFlags buffer_usage;
+	VkFormat format;
+	uint32_t width, height, mips;
+	VkImageUsageFlags image_usage;
+};
+
+static resource buf(VkDeviceSize size, VkBufferUsageFlags usage) {
+	return {false, size, usage, VK_FORMAT_UNDEFINED, 0, 0, 0, 0};
+}
+
+static resource img(VkFormat format, uint32_t width, uint32_t height, uint32_t mips, VkImageUsageFlags usage) {
+	return {true, 0, 0, format, width, height, mips, usage};
+}
+
+struct resource_set {
+	char const * name;
+	std::vector<resource> resources; //in the order the application created them
+};
+
+static constexpr VkBufferUsageFlags uniform = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+static constexpr VkBufferUsageFlags storage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+static constexpr VkBufferUsageFlags vertex = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+static constexpr VkBufferUsageFlags indices = VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+static constexpr VkImageUsageFlags target = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+static constexpr VkImageUsageFlags depth = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+static constexpr VkImageUsageFlags texture = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+static constexpr VkImageUsageFlags storage_image = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+
+static std::vector<resource_set> modeled_sets() {
+	return {
+		{"deferred renderer", {
+			buf(256, uniform),
+			img(VK_FORMAT_R8G8B8A8_UNORM, 1920, 1080, 1, target),
+			buf(1 << 20, vertex),
+			img(VK_FORMAT_R16G16B16A16_SFLOAT, 1920, 1080, 1, target),
+			buf(256, uniform),
+			img(VK_FORMAT_D32_SFLOAT, 1920, 1080, 1, depth),
+			buf(256 << 10, indices),
+			img(VK_FORMAT_R8G8B8A8_UNORM, 1920, 1080, 1, target),
+			buf(64 << 10, storage),
+			img(VK_FORMAT_R16G16B16A16_SFLOAT, 1920, 1080, 1, target),
+			buf(1024, uniform),
+		}},
+		{"texture streaming", {
+			img(VK_FORMAT_R8G8B8A8_UNORM, 2048, 2048, 12, texture),
+			buf(4096, uniform),
+			img(VK_FORMAT_R8G8B8A8_UNORM, 256, 256, 9, texture),
+			buf(4096, uniform),
+			img(VK_FORMAT_R8G8B8A8_UNORM, 1024, 1024, 11, texture),
+			buf(4096, uniform),
+			img(VK_FORMAT_R8G8B8A8_UNORM, 64, 64, 7, texture),
+			buf(4096, uniform),
+			img(VK_FORMAT_R8G8B8A8_UNORM, 512, 512, 10, texture),
+			buf(4096, uniform),
+			img(VK_FORMAT_R8G8B8A8_UNORM, 128, 128, 8, texture),
+			buf(4096, uniform),
+		}},
+		{"particle simulation", {
+			buf(48 * 100000, storage),
+			img(VK_FORMAT_R32_SFLOAT, 512, 512, 1, storage_image),
+			buf(16, uniform),
+			buf(4 * 100000, storage),
+			img(VK_FORMAT_R32G32_SFLOAT, 256, 256, 1, storage_image),
+			buf(16, uniform),
+			buf(48 * 100000, storage),
+			img(VK_FORMAT_R32_SFLOAT, 512, 512, 1, storage_image),
+			buf(20, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | storage),
+		}},
+	};
+}
+
+static VkDeviceSize align_up(VkDeviceSize position, VkDeviceSize alignment) {
+	return alignment ? (position + alignment - 1) / alignment * alignment : position;
+}
+
+//the size of the allocation when placed as listed, the way the constructor used to
+static VkDeviceSize listed_order_size(vk::device const & dev, std::vector<vk::memory_bound_structure *> const & structures) {
+	VkDeviceSize size = 0;
+	for (size_t i = 0; i < structures.size(); i++) {
+		VkMemoryRequirements req = structures[i]->memory_requirements();
+		VkDeviceSize alignment = req.alignment;
+		if (i && structures[i]->linear() != structures[i - 1]->linear()) alignment = std::max(alignment, dev.parent.properties.limits.bufferImageGranularity);
+		size = align_up(size, alignment) + req.size;
+	}
+	return size;
+}
+
+static void run(vk::device & dev) {
+	printf("%-20s %10s %14s %14s %14s %14s\n", "set", "resources", "used", "listed waste", "packed waste", "saved");
+	for (resource_set const & set : modeled_sets()) {
+		std::vector<std::unique_ptr<vk::memory_bound_structure>> owned;
+		std::vector<vk::memory_bound_structure *> structures;
+		for (resource const & r : set.resources) {
+			if (r.image) owned.emplace_back(new vk::image {dev, VK_IMAGE_TYPE_2D, r.format, {r.width, r.height, 1}, r.image_usage, 0, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_LAYOUT_UNDEFINED, r.mips});
+			else owned.emplace_back(new vk::buffer {dev, r.size, r.buffer_usage});
+			structures.push_back(owned.back().get());
+		}
+		uint32_t type_bits = UINT32_MAX;
+		VkDeviceSize used = 0;
+		for (vk::memory_bound_structure * s : structures) {
+			VkMemoryRequirements req = s->memory_requirements();
+			type_bits &= req.memoryTypeBits;
+			used += req.size;
+		}
+		if (!type_bits) {
+			printf("%-20s skipped, no memory type fits every resource\n", set.name);
+			continue;
+		}
+		VkDeviceSize listed = listed_order_size(dev, structures) - used;
+		vk::memory packed {dev, dev.parent.find_memory(vk::memory_profile::gpu_only, type_bits), structures};
+		printf("%-20s %10zu %14llu %14llu %14llu %14llu\n", set.name, structures.size(), static_cast<unsigned long long>(used), static_cast<unsigned long long>(listed), static_cast<unsigned long long>(packed.wasted()), static_cast<unsigned long long>(listed > packed.wasted() ? listed - packed.wasted() : 0));
+	}
+}
+
+int main() {
+	int result = 1;
+	vk::instance::init();
+	try {
+		vk::device::initializer init {vk::get_physical_devices().front(), {vk::device::capability::compute}};
+		vk::device dev {init};
+		run(dev);
+		result = 0;
+	} catch (std::exception & e) {
+		fprintf(stderr, "%s\n", e.what());
+	}
+	vk::instance::term();
+	return result;
+}
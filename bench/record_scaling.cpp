@@ -0,0 +1,89 @@
+/*
+	Times frame_ring::record_parallel with 1 worker and then twice as many each time, up to the hardware threads. Every
+	frame records the same 64 secondaries of 64 items each, and every item records a barrier and a buffer fill. Prints
+	the mean recording time per frame and the speedup over one worker. Frames are submitted, but only recording is timed.
+*/
+
+#include "vulkanomics.hpp"
+
+#include <cstdio>
+
+static constexpr uint32_t frames_in_flight = 2;
+static constexpr uint32_t warmup_frames = 8;
+static constexpr uint32_t measured_frames = 64;
+static constexpr size_t secondaries = 64;
+static constexpr size_t items_per_secondary = 64;
+static constexpr size_t items = secondaries * items_per_secondary;
+
+static double frame_milliseconds(vk::device & dev, vk::queue_accessor & queue, vk::buffer & target, uint32_t workers) {
+	vk::job_system jobs {workers};
+	std::vector<std::unique_ptr<vk::fence>> done; //outlive the ring, which waits on them
+	for (uint32_t i = 0; i < frames_in_flight; i++) done.emplace_back(new vk::fence {dev});
+	vk::command::frame_ring ring {dev, queue.queue_family, frames_in_flight};
+
+	std::function<void(vk::command::buffer &, size_t)> record = [&target](vk::command::buffer & cmd, size_t item){
+		VkMemoryBarrier mb = {VK_STRUCTURE_TYPE_MEMORY_BARRIER, nullptr, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_WRITE_BIT};
+		cmd.barrier(VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, &mb, 1, nullptr, 0, nullptr, 0);
+		cmd.fill_buffer(target, (item % 256) * 256, 256, static_cast<uint32_t>(item));
+	};
+
+	std::chrono::steady_clock::duration recording {0};
+	for (uint32_t n = 0; n < warmup_frames + measured_frames; n++) {
+		vk::fence & f = *done[ring.frame()];
+		f.reset();
+		vk::command::buffer & primary = ring.acquire();
+		primary.begin();
+		auto start = std::chrono::steady_clock::now();
+		ring.record_parallel(jobs, primary, items, record, nullptr, items_per_secondary);
+		if (n >= warmup_frames) recording += std::chrono::steady_clock::now() - start;
+		primary.end();
+
+		VkSubmitInfo submit_info = {
+			.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+			.pNext = nullptr,
+			.waitSemaphoreCount = 0,
+			.pWaitSemaphores = nullptr,
+			.pWaitDstStageMask = nullptr,
+			.commandBufferCount = 1,
+			.pCommandBuffers = &primary.handle,
+			.signalSemaphoreCount = 0,
+			.pSignalSemaphores = nullptr,
+		};
+		queue.submit(&submit_info, 1, f);
+		ring.advance(f);
+	}
+	return std::chrono::duration<double, std::milli>(recording).count() / measured_frames;
+}
+
+static void run(vk::device & dev) {
+	vk::queue_accessor_direct queue {dev, 0};
+	vk::memory_heap heap {dev};
+	vk::buffer target {dev, 256 * 256, VK_BUFFER_USAGE_TRANSFER_DST_BIT};
+	heap.bind(target, vk::memory_profile::gpu_only);
+
+	uint32_t max_workers = std::max(1u, std::thread::hardware_concurrency());
+	printf("%zu secondaries of %zu items per frame\n", secondaries, items_per_secondary);
+	printf("%8s %12s %10s\n", "workers", "ms/frame", "speedup");
+	double single = 0;
+	for (uint32_t workers = 1; ; workers = std::min(workers * 2, max_workers)) {
+		double ms = frame_milliseconds(dev, queue, target, workers);
+		if (workers == 1) single = ms;
+		printf("%8u %12.3f %10.2f\n", workers, ms, single / ms);
+		if (workers == max_workers) break;
+	}
+}
+
+int main() {
+	int result = 1;
+	vk::instance::init();
+	try {
+		vk::device::initializer init {vk::get_physical_devices().front(), {vk::device::capability::compute}};
+		vk::device dev {init};
+		run(dev);
+		result = 0;
+	} catch (std::exception & e) {
+		fprintf(stderr, "%s\n", e.what());
+	}
+	vk::instance::term();
+	return result;
+}
@@ -0,0 +1,117 @@
+/*
+	Checks the ordering retirement_queue::collect relies on, against a real device: an epoch is only freed once every
+	earlier one has passed, whatever tells that it did; command buffers wait for their pool even once their epoch has
+	passed; and a heap being destroyed takes its pending ranges with it, retiring its blocks instead. The device's
+	destroy and free functions are wrapped to count what actually reaches the driver. Exits with 1 if any check fails.
+*/
+
+#include "vulkanomics.hpp"
+
+#include <cstdio>
+
+static int failures = 0;
+
+static void check(bool ok, char const * what) {
+	printf("%s: %s\n", ok ? "ok" : "FAILED", what);
+	if (!ok) failures++;
+}
+
+static std::atomic<uint32_t> destroyed_buffers {0}, freed_command_buffers {0}, freed_memories {0};
+static PFN_vkDestroyBuffer destroy_buffer;
+static PFN_vkFreeCommandBuffers free_command_buffers;
+static PFN_vkFreeMemory free_memory;
+
+static VKAPI_ATTR void VKAPI_CALL counting_destroy_buffer(VkDevice dev, VkBuffer b, VkAllocationCallbacks const * alloc) {
+	destroyed_buffers++;
+	destroy_buffer(dev, b, alloc);
+}
+
+static VKAPI_ATTR void VKAPI_CALL counting_free_command_buffers(VkDevice dev, VkCommandPool pool, uint32_t count, VkCommandBuffer const * handles) {
+	freed_command_buffers += count;
+	free_command_buffers(dev, pool, count, handles);
+}
+
+static VKAPI_ATTR void VKAPI_CALL counting_free_memory(VkDevice dev, VkDeviceMemory mem, VkAllocationCallbacks const * alloc) {
+	freed_memories++;
+	free_memory(dev, mem, alloc);
+}
+
+//signals f once the queue gets to it
+static void signal(vk::queue_accessor & queue, vk::fence & f) {
+	VkSubmitInfo submit_info = {
+		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+		.pNext = nullptr,
+		.waitSemaphoreCount = 0,
+		.pWaitSemaphores = nullptr,
+		.pWaitDstStageMask = nullptr,
+		.commandBufferCount = 0,
+		.pCommandBuffers = nullptr,
+		.signalSemaphoreCount = 0,
+		.pSignalSemaphores = nullptr,
+	};
+	queue.submit(&submit_info, 1, f);
+	f.wait();
+}
+
+static void run(vk::device & dev) {
+	destroy_buffer = dev.vkDestroyBuffer;
+	free_command_buffers = dev.vkFreeCommandBuffers;
+	free_memory = dev.vkFreeMemory;
+	dev.vkDestroyBuffer = &counting_destroy_buffer;
+	dev.vkFreeCommandBuffers = &counting_free_command_buffers;
+	dev.vkFreeMemory = &counting_free_memory;
+
+	vk::queue_accessor_direct queue {dev, 0};
+	vk::command::pool pool {dev, 0, queue.queue_family};
+	vk::fence first {dev}, second {dev}, third {dev};
+	vk::retirement_queue rq {dev};
+
+	{ vk::buffer b {dev, 256, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT}; }
+	rq.close(first);
+	{ vk::buffer b {dev, 256, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT}; }
+	rq.close(second);
+	signal(queue, second);
+	check(rq.collect() == 0 && destroyed_buffers == 0, "an epoch whose fence signaled waits for the earlier epoch");
+	signal(queue, first);
+	check(rq.collect() == 2 && destroyed_buffers == 2, "both epochs are freed once the earlier one passes");
+
+	{ vk::buffer b {dev, 256, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT}; }
+	uint64_t epoch = rq.close();
+	check(rq.collect() == 0, "an epoch closed without a fence waits for passed()");
+	rq.passed(epoch);
+	check(rq.collect() == 1 && destroyed_buffers == 3, "passed() frees the epoch");
+
+	{ vk::command::buffer cmd {pool}; }
+	rq.close(third);
+	signal(queue, third);
+	rq.collect();
+	check(freed_command_buffers == 0 && rq.pending() == 1, "a passed command buffer is held for its pool");
+	check(rq.collect_command_pool(pool.handle) == 1 && freed_command_buffers == 1 && rq.pending() == 0, "collecting the pool frees it");
+
+	{
+		vk::memory_heap heap {dev};
+		{
+			vk::buffer b {dev, 4096, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT};
+			heap.bind(b, vk::memory_profile::gpu_only);
+		}
+		check(rq.pending() == 2, "a destroyed buffer retires its handle and its range");
+	}
+	check(rq.pending() == 2 && freed_memories == 0, "destroying the heap drops the range and retires its block");
+	epoch = rq.close();
+	rq.passed(epoch);
+	check(rq.collect() == 2 && destroyed_buffers == 4 && freed_memories == 1, "the epoch frees the buffer and the block, the range is gone with its heap");
+}
+
+int main() {
+	vk::instance::init();
+	try {
+		vk::device::initializer init {vk::get_physical_devices().front(), {vk::device::capability::compute}};
+		vk::device dev {init};
+		run(dev);
+	} catch (std::exception & e) {
+		fprintf(stderr, "%s\n", e.what());
+		failures++;
+	}
+	vk::instance::term();
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,122 @@
+/*
+	Counts the heap allocations of a steady-state frame: a primary from the frame ring with secondaries recorded in
+	parallel on the job system, barriers, a descriptor update and a staging upload. Once the warm-up frames have
+	grown every container to its size, and given every worker its command buffers, a frame must not allocate at all.
+	Every operator new of the process is counted, worker threads included; exits with 1 if any measured frame allocated.
+*/
+
+#include "vulkanomics.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+static std::atomic<size_t> allocations {0};
+static std::atomic_bool counting {false};
+
+void * operator new(std::size_t size) {
+	if (counting.load(std::memory_order_relaxed)) allocations++;
+	void * p = std::malloc(size ? size : 1);
+	if (!p) throw std::bad_alloc {};
+	return p;
+}
+void * operator new[](std::size_t size) { return operator new(size); }
+void * operator new(std::size_t size, std::nothrow_t const &) noexcept {
+	try { return operator new(size); } catch (...) { return nullptr; }
+}
+void * operator new[](std::size_t size, std::nothrow_t const &) noexcept {
+	try { return operator new(size); } catch (...) { return nullptr; }
+}
+void operator delete(void * p) noexcept { std::free(p); }
+void operator delete[](void * p) noexcept { std::free(p); }
+void operator delete(void * p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void * p, std::size_t) noexcept { std::free(p); }
+
+static constexpr uint32_t frames_in_flight = 2;
+static constexpr uint32_t warmup_frames = 64;
+static constexpr uint32_t measured_frames = 256;
+static constexpr size_t items = 64; //recorded in parallel, one fill each
+static constexpr size_t grain = items / 8; //no more secondaries per thread and frame than the ring allocates at once
+static constexpr VkDeviceSize item_size = 256;
+
+static int run(vk::device & dev) {
+	vk::queue_accessor_direct queue {dev, 0};
+	vk::job_system jobs {4};
+	std::vector<std::unique_ptr<vk::fence>> done; //outlive the ring, which waits on them
+	for (uint32_t i = 0; i < frames_in_flight; i++) done.emplace_back(new vk::fence {dev});
+	vk::command::frame_ring ring {dev, queue.queue_family, frames_in_flight};
+	vk::memory_heap heap {dev};
+	vk::buffer target {dev, items * item_size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT};
+	vk::buffer uploads {dev, 4096, VK_BUFFER_USAGE_TRANSFER_DST_BIT};
+	heap.bind(target, vk::memory_profile::gpu_only);
+	heap.bind(uploads, vk::memory_profile::gpu_only);
+	vk::staging_ring staging {dev, queue, 1 << 20};
+	vk::descriptor::layout layout {dev, {{0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr}}};
+	vk::descriptor::pool pool {dev, {{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1}}, 1};
+	vk::descriptor::set set {pool, layout};
+	vk::descriptor::update_session update {dev};
+	uint32_t payload[64] = {};
+
+	auto frame = [&](uint32_t n) {
+		vk::fence & f = *done[ring.frame()];
+		f.reset(); //waited on by advance() when the ring last came around
+
+		vk::command::buffer & primary = ring.acquire();
+		primary.begin();
+		VkMemoryBarrier mb = {VK_STRUCTURE_TYPE_MEMORY_BARRIER, nullptr, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_WRITE_BIT};
+		primary.barrier(VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, &mb, 1, nullptr, 0, nullptr, 0);
+		bool warming = n < warmup_frames;
+		ring.record_parallel(jobs, primary, items, [&target, warming](vk::command::buffer & cmd, size_t item){
+			if (warming) std::this_thread::sleep_for(std::chrono::microseconds {100}); //slow enough for every worker to take a task
+			cmd.fill_buffer(target, item * item_size, item_size, static_cast<uint32_t>(item));
+		}, nullptr, grain);
+		primary.end();
+
+		update.clear();
+		VkDescriptorBufferInfo info = target.descript();
+		update.write_buffer(set, 0, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &info, 1);
+		update.update();
+
+		payload[0] = n;
+		staging.upload(uploads, 0, payload, sizeof(payload));
+		staging.submit();
+
+		VkSubmitInfo submit_info = {
+			.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+			.pNext = nullptr,
+			.waitSemaphoreCount = 0,
+			.pWaitSemaphores = nullptr,
+			.pWaitDstStageMask = nullptr,
+			.commandBufferCount = 1,
+			.pCommandBuffers = &primary.handle,
+			.signalSemaphoreCount = 0,
+			.pSignalSemaphores = nullptr,
+		};
+		queue.submit(&submit_info, 1, f);
+		ring.advance(f);
+	};
+
+	uint32_t n = 0;
+	for (; n < warmup_frames; n++) frame(n);
+	counting = true;
+	for (; n < warmup_frames + measured_frames; n++) frame(n);
+	counting = false;
+
+	size_t count = allocations.load();
+	printf("%zu heap allocations in %u steady-state frames\n", count, measured_frames);
+	return count ? 1 : 0;
+}
+
+int main() {
+	int result = 1;
+	vk::instance::init();
+	try {
+		vk::device::initializer init {vk::get_physical_devices().front(), {vk::device::capability::compute}};
+		vk::device dev {init};
+		result = run(dev);
+	} catch (std::exception & e) {
+		fprintf(stderr, "%s\n", e.what());
+	}
+	vk::instance::term();
+	return result;
+}
@@ -0,0 +1,72 @@
+/*
+	Measures submit throughput under contention: 1 to 64 threads each make a fixed number of empty submits on the same
+	queue, through queue_accessor_mutexed and then queue_accessor_coalescing. Prints submits per second for both
+	accessors at every thread count. The submits carry no command buffers and no fence, so it is the cost of getting
+	to vkQueueSubmit and of the call itself that is measured.
+*/
+
+#include "vulkanomics.hpp"
+
+#include <cstdio>
+
+static constexpr uint32_t submits_per_thread = 2000;
+static constexpr uint32_t thread_counts[] = {1, 2, 4, 8, 16, 32, 64};
+
+static double measure(vk::queue_accessor & queue, uint32_t threads) {
+	std::atomic<uint32_t> ready {0};
+	std::atomic_bool go {false};
+	std::vector<std::thread> pool;
+	for (uint32_t t = 0; t < threads; t++) pool.emplace_back([&](){
+		VkSubmitInfo info = {
+			.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+			.pNext = nullptr,
+			.waitSemaphoreCount = 0,
+			.pWaitSemaphores = nullptr,
+			.pWaitDstStageMask = nullptr,
+			.commandBufferCount = 0,
+			.pCommandBuffers = nullptr,
+			.signalSemaphoreCount = 0,
+			.pSignalSemaphores = nullptr,
+		};
+		ready++;
+		while (!go.load(std::memory_order_acquire)) std::this_thread::yield();
+		for (uint32_t i = 0; i < submits_per_thread; i++) queue.submit(&info, 1, VK_NULL_HANDLE);
+	});
+	while (ready.load() < threads) std::this_thread::yield();
+	auto start = std::chrono::steady_clock::now();
+	go.store(true, std::memory_order_release);
+	for (std::thread & th : pool) th.join();
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	return threads * submits_per_thread / elapsed.count();
+}
+
+static void run(vk::device & dev) {
+	printf("%8s %16s %16s\n", "threads", "mutexed/s", "coalescing/s");
+	for (uint32_t threads : thread_counts) {
+		double mutexed, coalescing;
+		{
+			vk::queue_accessor_mutexed queue {dev, 0};
+			mutexed = measure(queue, threads);
+		}
+		{
+			vk::queue_accessor_coalescing queue {dev, 0};
+			coalescing = measure(queue, threads);
+		}
+		printf("%8u %16.0f %16.0f\n", threads, mutexed, coalescing);
+	}
+}
+
+int main() {
+	int result = 1;
+	vk::instance::init();
+	try {
+		vk::device::initializer init {vk::get_physical_devices().front(), {vk::device::capability::compute}};
+		vk::device dev {init};
+		run(dev);
+		result = 0;
+	} catch (std::exception & e) {
+		fprintf(stderr, "%s\n", e.what());
+	}
+	vk::instance::term();
+	return result;
+}
@@ -0,0 +1,157 @@
+/*
+	Checks what task_graph::compile derives from the declared accesses, against a real device: read after write, write
+	after read and write after write each order their nodes and put a barrier in front of the later one, unless an
+	earlier barrier already covers it; a buffer used on another queue family is released and acquired around the
+	crossing and handed back to its first family at the end of the run; and a cycle is refused. The schedule is
+	compared through trace(), the ordering through the data the copies leave behind, over two runs of the same
+	recording. The ownership checks need a transfer queue of its own family and are skipped without one. Exits with 1
+	if any check fails.
+*/
+
+#include "vulkanomics.hpp"
+
+#include <cstdio>
+#include <cstring>
+
+static int failures = 0;
+
+static void check(bool ok, char const * what) {
+	printf("%s: %s\n", ok ? "ok" : "FAILED", what);
+	if (!ok) failures++;
+}
+
+static void check_trace(std::string const & trace, std::string const & expected, char const * what) {
+	check(trace == expected, what);
+	if (trace != expected) printf("expected:\n%sgot:\n%s", expected.c_str(), trace.c_str());
+}
+
+static constexpr VkDeviceSize size = 256;
+
+static void fill(vk::buffer & b, uint8_t value) {
+	memset(b.map(), value, size);
+	b.unmap();
+}
+
+static bool holds(vk::buffer & b, uint8_t value) {
+	b.invalidate();
+	uint8_t const * data = static_cast<uint8_t const *>(b.data());
+	for (VkDeviceSize i = 0; i < size; i++) if (data[i] != value) return false;
+	return true;
+}
+
+static void hazards(vk::device & dev, vk::queue_accessor & queue, vk::memory_heap & heap) {
+	std::vector<std::unique_ptr<vk::buffer>> owned;
+	auto make = [&]() -> vk::buffer & {
+		owned.emplace_back(new vk::buffer {dev, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT});
+		heap.bind(*owned.back(), vk::memory_profile::gpu_to_cpu);
+		return *owned.back();
+	};
+	vk::buffer & one = make(), & two = make(), & a = make(), & b = make(), & c = make(), & d = make();
+	fill(one, 1);
+	fill(two, 2);
+
+	vk::task_graph graph {dev, {&queue}};
+	graph.copy("copy one to a", one, a, {0, 0, size});
+	graph.copy("copy two to b", two, b, {0, 0, size});
+	graph.copy("copy a to c", a, c, {0, 0, size}); //reads after 0 wrote
+	graph.copy("copy two to a", two, a, {0, 0, size}); //writes after 2 read and 0 wrote
+	graph.copy("copy b to d", b, d, {0, 0, size}); //reads after 1 wrote, made visible by the barrier before 2
+	graph.compile();
+	check_trace(graph.trace(),
+		"submission 0 on queue 0 (family " + std::to_string(queue.queue_family) + ")\n"
+		"\t0 copy one to a\n"
+		"\t1 copy two to b\n"
+		"\t2 copy a to c [barrier]\n"
+		"\t3 copy two to a [barrier]\n"
+		"\t4 copy b to d\n",
+		"hazards order the nodes and a barrier covers every later node it can");
+
+	for (uint32_t run = 0; run < 2; run++) {
+		fill(c, 0);
+		fill(d, 0);
+		graph.run();
+		check(holds(c, 1) && holds(a, 2) && holds(d, 2), run ? "a second run of the recording orders the same" : "a is read before it is overwritten");
+	}
+
+	bool refused = false;
+	try {
+		graph.copy("late", one, b, {0, 0, size});
+	} catch (vk::exception &) {
+		refused = true;
+	}
+	check(refused, "a compiled graph refuses new nodes");
+
+	vk::task_graph cycle {dev, {&queue}};
+	vk::task_graph::node_id first = cycle.copy("copy one to a", one, a, {0, 0, size});
+	vk::task_graph::node_id second = cycle.copy("copy a to c", a, c, {0, 0, size});
+	cycle.order(second, first);
+	refused = false;
+	try {
+		cycle.compile();
+	} catch (vk::exception &) {
+		refused = true;
+	}
+	check(refused, "an order() against a hazard is a cycle and refused");
+}
+
+static void ownership(vk::device & dev, vk::queue_accessor & compute, vk::queue_accessor & transfer, vk::memory_heap & heap) {
+	vk::buffer one {dev, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT}, a {dev, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT}, c {dev, size, VK_BUFFER_USAGE_TRANSFER_DST_BIT};
+	heap.bind(one, vk::memory_profile::gpu_to_cpu);
+	heap.bind(a, vk::memory_profile::gpu_to_cpu);
+	heap.bind(c, vk::memory_profile::gpu_to_cpu);
+	fill(one, 1);
+
+	vk::task_graph graph {dev, {&compute, &transfer}};
+	graph.copy("copy one to a", one, a, {0, 0, size}); //on the dedicated transfer queue
+	vk::buffer const * src = &a;
+	vk::buffer * dst = &c;
+	graph.custom("copy a to c on compute", vk::device::capability::compute, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, {&a}, {&c}, [src, dst](vk::command::buffer & cmd){
+		VkBufferCopy region = {0, 0, size};
+		cmd.copy_buffer(*src, *dst, &region, 1);
+	});
+	graph.compile();
+	std::string transfer_family = std::to_string(transfer.queue_family), compute_family = std::to_string(compute.queue_family);
+	check_trace(graph.trace(),
+		"submission 0 on queue 1 (family " + transfer_family + ")\n"
+		"\t0 copy one to a [releases 1]\n"
+		"submission 1 on queue 0 (family " + compute_family + ") after 0\n"
+		"\t1 copy a to c on compute [acquires 1] [releases 1]\n"
+		"submission 2 on queue 1 (family " + transfer_family + ") after 1\n"
+		"\t2 return ownership [acquires 1]\n",
+		"a buffer crossing families is released, acquired behind a semaphore and handed back");
+
+	for (uint32_t run = 0; run < 2; run++) {
+		fill(c, 0);
+		graph.run();
+		check(holds(c, 1), run ? "the second run finds the buffer where the first left it" : "the compute queue reads what the transfer queue wrote");
+	}
+}
+
+static void run(vk::device & dev) {
+	vk::memory_heap heap {dev};
+	vk::queue_accessor_direct compute {dev, 0};
+	hazards(dev, compute, heap);
+	if (dev.queues.size() < 2 || dev.queues[1].queue_family == dev.queues[0].queue_family) {
+		printf("skipped: no transfer queue of its own family\n");
+		return;
+	}
+	vk::queue_accessor_direct transfer {dev, 1};
+	ownership(dev, compute, transfer, heap);
+}
+
+int main() {
+	vk::instance::init();
+	try {
+		vk::physical_device const & pdev = vk::get_physical_devices().front();
+		vk::device::capability_set caps {vk::device::capability::compute};
+		if (pdev.queue_families.size() > 1) caps.push_back(vk::device::capability::transfer); //lands on a family of its own where there is one
+		vk::device::initializer init {pdev, caps};
+		vk::device dev {init};
+		run(dev);
+	} catch (std::exception & e) {
+		fprintf(stderr, "%s\n", e.what());
+		failures++;
+	}
+	vk::instance::term();
+	return failures ? 1 : 0;
+}
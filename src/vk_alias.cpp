@@ -0,0 +1,120 @@
+#include "vulkanomics.hpp"
+#include "vk_internal.hpp"
+
+#include <numeric>
+
+void vk::alias_planner::add(vk::buffer & b, uint32_t first_use, uint32_t last_use) {
+	if (first_use > last_use) srcthrow("first use %u is after last use %u", first_use, last_use);
+	entries.push_back({&b, nullptr, b.memory_requirements(), first_use, last_use, VK_IMAGE_LAYOUT_UNDEFINED, 0, 0, false});
+	planned = false;
+}
+
+void vk::alias_planner::add(vk::image & img, uint32_t first_use, uint32_t last_use, VkImageLayout first_layout, VkImageAspectFlags aspect) {
+	if (first_use > last_use) srcthrow("first use %u is after last use %u", first_use, last_use);
+	VkMemoryRequirements req = img.memory_requirements();
+	if (!img.linear()) { //whole granularity pages, so linear neighbors never share one
+		VkDeviceSize granularity = parent.parent.properties.limits.bufferImageGranularity;
+		req.alignment = std::max(req.alignment, granularity);
+		req.size = next_alignment(req.size, granularity);
+	}
+	entries.push_back({&img, &img, req, first_use, last_use, first_layout, aspect, 0, false});
+	planned = false;
+}
+
+static inline bool lifetimes_overlap(uint32_t a_first, uint32_t a_last, uint32_t b_first, uint32_t b_last) {
+	return a_first <= b_last && b_first <= a_last;
+}
+
+VkDeviceSize vk::alias_planner::plan() {
+	std::vector<size_t> order(entries.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::sort(order.begin(), order.end(), [this](size_t a, size_t b){
+		if (entries[a].req.size != entries[b].req.size) return entries[a].req.size > entries[b].req.size;
+		if (entries[a].req.alignment != entries[b].req.alignment) return entries[a].req.alignment > entries[b].req.alignment;
+		return a < b;
+	});
+
+	size_ = 0;
+	std::vector<size_t> placed;
+	std::vector<std::pair<VkDeviceSize, VkDeviceSize>> busy;
+	for (size_t i : order) {
+		entry & e = entries[i];
+		busy.clear();
+		for (size_t j : placed) {
+			entry const & p = entries[j];
+			if (lifetimes_overlap(e.first_use, e.last_use, p.first_use, p.last_use)) busy.emplace_back(p.offset, p.offset + p.req.size);
+		}
+		std::sort(busy.begin(), busy.end());
+		VkDeviceSize offset = 0;
+		for (std::pair<VkDeviceSize, VkDeviceSize> const & b : busy) {
+			if (offset + e.req.size <= b.first) break;
+			if (b.second > offset) offset = next_alignment(b.second, e.req.alignment);
+		}
+		e.offset = offset;
+		size_ = std::max(size_, offset + e.req.size);
+		placed.push_back(i);
+	}
+
+	for (entry & e : entries) {
+		e.takes_over = std::any_of(entries.begin(), entries.end(), [&e](entry const & o){
+			return o.last_use < e.first_use && o.offset < e.offset + e.req.size && e.offset < o.offset + o.req.size;
+		});
+	}
+
+	planned = true;
+	return size_;
+}
+
+VkDeviceSize vk::alias_planner::unaliased_size() const {
+	VkDeviceSize size = 0;
+	for (entry const & e : entries) size = next_alignment(size, e.req.alignment) + e.req.size;
+	return size;
+}
+
+uint32_t vk::alias_planner::memory_type_bits() const {
+	uint32_t bits = UINT32_MAX;
+	for (entry const & e : entries) bits &= e.req.memoryTypeBits;
+	return bits;
+}
+
+void vk::alias_planner::bind(vk::memory & mem) {
+	if (!planned) plan();
+	if (mem.size() < size_) srcthrow("memory of %llu bytes cannot hold the planned %llu bytes", static_cast<unsigned long long>(mem.size()), static_cast<unsigned long long>(size_));
+	if (!(memory_type_bits() & (1u << mem.memory_type()))) srcthrow("memory type %u is not supported by every planned resource", mem.memory_type());
+	for (entry & e : entries) e.res->bind_to_memory(e.offset, mem);
+}
+
+void vk::alias_planner::record_barriers(command::buffer & cmd, uint32_t use, VkPipelineStageFlags src_stages, VkPipelineStageFlags dst_stages) {
+	VkMemoryBarrier memory_barrier = {VK_STRUCTURE_TYPE_MEMORY_BARRIER, nullptr, VK_ACCESS_MEMORY_WRITE_BIT, VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT};
+	bool buffers = false;
+	image_barriers_scratch.clear();
+	for (entry const & e : entries) {
+		if (!e.takes_over || e.first_use != use) continue;
+		if (!e.img) {
+			buffers = true;
+			continue;
+		}
+		VkImageMemoryBarrier b = {
+			.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+			.pNext = nullptr,
+			.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT,
+			.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT,
+			.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+			.newLayout = e.first_layout,
+			.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.image = *e.img,
+			.subresourceRange = {
+				.aspectMask = e.aspect,
+				.baseMipLevel = 0,
+				.levelCount = VK_REMAINING_MIP_LEVELS,
+				.baseArrayLayer = 0,
+				.layerCount = VK_REMAINING_ARRAY_LAYERS,
+			},
+		};
+		image_barriers_scratch.push_back(b);
+		e.img->set_layout(e.first_layout); //every subresource is transitioned
+	}
+	if (!buffers && image_barriers_scratch.empty()) return;
+	cmd.barrier(src_stages, dst_stages, &memory_barrier, buffers ? 1 : 0, nullptr, 0, image_barriers_scratch.data(), image_barriers_scratch.size());
+}
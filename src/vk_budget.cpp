@@ -0,0 +1,122 @@
+#include "vulkanomics.hpp"
+#include "vk_internal.hpp"
+
+static inline void raise_peak(std::atomic<VkDeviceSize> & peak, VkDeviceSize value) {
+	VkDeviceSize cur = peak.load(std::memory_order_relaxed);
+	while (cur < value && !peak.compare_exchange_weak(cur, value, std::memory_order_relaxed)) {}
+}
+
+vk::memory_budget::memory_budget(device const & parent) : parent(parent) {
+	for (uint32_t h = 0; h < VK_MAX_MEMORY_HEAPS; h++) {
+		driver_heap_budget[h] = 0;
+		driver_heap_usage[h] = 0;
+		trigger[h] = UINT64_MAX;
+		rearm[h] = 0;
+	}
+}
+
+VkDeviceSize vk::memory_budget::heap_budget(uint32_t heap) const {
+	if (driver_budget_.load(std::memory_order_acquire)) return driver_heap_budget[heap];
+	return parent.parent.memory_properties.memoryHeaps[heap].size;
+}
+
+VkDeviceSize vk::memory_budget::heap_usage(uint32_t heap) const {
+	return driver_heap_usage[heap].load(std::memory_order_relaxed) + heaps[heap].bytes.load(std::memory_order_relaxed);
+}
+
+void vk::memory_budget::refresh() {
+	#ifdef VK_EXT_memory_budget
+	if (parent.has_extension("VK_EXT_memory_budget")) {
+		VkPhysicalDeviceMemoryBudgetPropertiesEXT budget_props = {
+			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT,
+			.pNext = nullptr,
+			.heapBudget = {},
+			.heapUsage = {},
+		};
+		VkPhysicalDeviceMemoryProperties2KHR props = {
+			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2_KHR,
+			.pNext = &budget_props,
+			.memoryProperties = {},
+		};
+		vk::GetPhysicalDeviceMemoryProperties2KHR(parent.parent.handle, &props);
+
+		std::lock_guard<std::mutex> lock(mut);
+		for (uint32_t h = 0; h < parent.parent.memory_properties.memoryHeapCount; h++) {
+			VkDeviceSize own = heaps[h].bytes.load(std::memory_order_relaxed);
+			driver_heap_budget[h] = budget_props.heapBudget[h];
+			driver_heap_usage[h] = budget_props.heapUsage[h] > own ? budget_props.heapUsage[h] - own : 0;
+		}
+		driver_budget_.store(true, std::memory_order_release); //after the budgets it makes heap_budget() return
+	}
+	#endif
+	for (uint32_t h = 0; h < parent.parent.memory_properties.memoryHeapCount; h++) evaluate(h);
+}
+
+uint32_t vk::memory_budget::add_pressure_callback(uint32_t heap, float fraction, pressure_callback cb) {
+	if (heap >= parent.parent.memory_properties.memoryHeapCount) srcthrow("memory heap %u does not exist", heap);
+	uint32_t id;
+	{
+		std::lock_guard<std::mutex> lock(mut);
+		id = next_id++;
+		pressures.push_back({id, heap, fraction, std::move(cb), false});
+	}
+	evaluate(heap);
+	return id;
+}
+
+void vk::memory_budget::remove_pressure_callback(uint32_t id) {
+	uint32_t heap;
+	{
+		std::lock_guard<std::mutex> lock(mut);
+		std::vector<pressure>::iterator iter = std::find_if(pressures.begin(), pressures.end(), [id](pressure const & p){return p.id == id;});
+		if (iter == pressures.end()) return;
+		heap = iter->heap;
+		pressures.erase(iter);
+	}
+	evaluate(heap);
+}
+
+void vk::memory_budget::allocated(uint32_t mem_type, VkDeviceSize size) {
+	uint32_t heap = parent.parent.memory_properties.memoryTypes[mem_type].heapIndex;
+	raise_peak(types[mem_type].peak, types[mem_type].bytes.fetch_add(size, std::memory_order_relaxed) + size);
+	types[mem_type].count.fetch_add(1, std::memory_order_relaxed);
+	raise_peak(heaps[heap].peak, heaps[heap].bytes.fetch_add(size, std::memory_order_relaxed) + size);
+	heaps[heap].count.fetch_add(1, std::memory_order_relaxed);
+	if (heap_usage(heap) >= trigger[heap].load(std::memory_order_relaxed)) evaluate(heap);
+}
+
+void vk::memory_budget::freed(uint32_t mem_type, VkDeviceSize size) {
+	uint32_t heap = parent.parent.memory_properties.memoryTypes[mem_type].heapIndex;
+	types[mem_type].bytes.fetch_sub(size, std::memory_order_relaxed);
+	types[mem_type].count.fetch_sub(1, std::memory_order_relaxed);
+	heaps[heap].bytes.fetch_sub(size, std::memory_order_relaxed);
+	heaps[heap].count.fetch_sub(1, std::memory_order_relaxed);
+	if (heap_usage(heap) < rearm[heap].load(std::memory_order_relaxed)) evaluate(heap);
+}
+
+//fires and rearms the callbacks of a heap, the callbacks run without the lock held so they may free memory
+void vk::memory_budget::evaluate(uint32_t heap) {
+	std::vector<pressure_callback> fire;
+	VkDeviceSize usage, budget;
+	{
+		std::lock_guard<std::mutex> lock(mut);
+		usage = heap_usage(heap);
+		budget = heap_budget(heap);
+		VkDeviceSize lowest_armed = UINT64_MAX, highest_fired = 0;
+		for (pressure & p : pressures) {
+			if (p.heap != heap) continue;
+			VkDeviceSize threshold = static_cast<VkDeviceSize>(p.fraction * budget);
+			if (!p.fired && usage >= threshold) {
+				p.fired = true;
+				fire.push_back(p.cb);
+			} else if (p.fired && usage < threshold) {
+				p.fired = false;
+			}
+			if (p.fired) highest_fired = std::max(highest_fired, threshold);
+			else lowest_armed = std::min(lowest_armed, threshold);
+		}
+		trigger[heap] = lowest_armed;
+		rearm[heap] = highest_fired;
+	}
+	for (pressure_callback const & cb : fire) cb(heap, usage, budget);
+}
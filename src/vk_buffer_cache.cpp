@@ -0,0 +1,124 @@
+#include "vulkanomics.hpp"
+#include "vk_internal.hpp"
+
+namespace {
+	//remembers where a cached buffer belongs, so release needs nothing but the buffer
+	struct cached_buffer : public vk::buffer {
+		vk::buffer_cache const * owner;
+		vk::memory_profile profile;
+		cached_buffer(vk::device const & parent, VkDeviceSize size, VkBufferUsageFlags usage, vk::buffer_cache const * owner, vk::memory_profile profile) : vk::buffer(parent, size, usage), owner(owner), profile(profile) {}
+	};
+}
+
+static constexpr VkDeviceSize min_size_class = 256;
+
+VkDeviceSize vk::buffer_cache::size_class(VkDeviceSize size) {
+	if (size <= min_size_class) return min_size_class;
+	VkDeviceSize step = (VkDeviceSize(1) << (63 - __builtin_clzll(size - 1))) / 4;
+	return next_alignment(size, step);
+}
+
+vk::buffer_cache::buffer_cache(memory_heap & heap) : parent(heap.parent), heap(heap) {}
+
+vk::buffer_cache::~buffer_cache() {
+	clear();
+	//the rest are still in use, the retirement queue defers their destruction by itself
+	if (parent.retirement) return;
+	for (std::pair<key const, std::vector<entry>> & list : entries) {
+		for (entry & e : list.second) {
+			if (e.last_use_fence) parent.vkWaitForFences(parent, 1, &e.last_use_fence, VK_TRUE, UINT64_MAX);
+			else e.last_use.wait();
+		}
+	}
+}
+
+bool vk::buffer_cache::passed(entry const & e) const {
+	if (!e.last_use_fence) return e.last_use.ready();
+	VkResult res = parent.vkGetFenceStatus(parent, e.last_use_fence);
+	if (res == VK_NOT_READY) return false;
+	VKR(res)
+	return true;
+}
+
+std::unique_ptr<vk::buffer> vk::buffer_cache::acquire(VkDeviceSize size, VkBufferUsageFlags usage, memory_profile profile) {
+	VkDeviceSize cls = size_class(size);
+	{
+		std::lock_guard<std::mutex> lock(mut);
+		std::map<key, std::vector<entry>>::iterator iter = entries.find(key {usage, cls, profile});
+		if (iter != entries.end()) {
+			std::vector<entry> & list = iter->second;
+			for (size_t i = 0; i < list.size(); i++) {
+				if (!passed(list[i])) continue;
+				std::unique_ptr<vk::buffer> buf = std::move(list[i].buf);
+				list.erase(list.begin() + i);
+				stats_.hits++;
+				stats_.buffers--;
+				stats_.bytes -= cls;
+				return buf;
+			}
+		}
+		stats_.misses++;
+	}
+	std::unique_ptr<vk::buffer> buf {new cached_buffer {parent, cls, usage, this, profile}};
+	heap.bind(*buf, profile);
+	return buf;
+}
+
+void vk::buffer_cache::release(std::unique_ptr<vk::buffer> buf, gpu_future last_use) {
+	insert(std::move(buf), last_use, VK_NULL_HANDLE);
+}
+
+void vk::buffer_cache::release(std::unique_ptr<vk::buffer> buf, vk::fence const & last_use) {
+	insert(std::move(buf), {}, last_use);
+}
+
+void vk::buffer_cache::insert(std::unique_ptr<vk::buffer> buf, gpu_future last_use, VkFence last_use_fence) {
+	if (!buf) return;
+	cached_buffer * cb = dynamic_cast<cached_buffer *>(buf.get());
+	if (!cb || cb->owner != this) srcthrow("buffer was not acquired from this cache");
+	std::lock_guard<std::mutex> lock(mut);
+	entries[key {cb->usage(), cb->size(), cb->profile}].push_back({std::move(buf), last_use, last_use_fence, std::chrono::steady_clock::now()});
+	stats_.buffers++;
+	stats_.bytes += cb->size();
+}
+
+void vk::buffer_cache::trim(VkDeviceSize max_bytes, std::chrono::steady_clock::duration max_idle) {
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	std::vector<std::unique_ptr<vk::buffer>> doomed;
+	{
+		std::lock_guard<std::mutex> lock(mut);
+		//every retired entry, oldest release first
+		std::vector<std::pair<std::chrono::steady_clock::time_point, std::pair<std::vector<entry> *, size_t>>> retired;
+		for (std::pair<key const, std::vector<entry>> & list : entries) {
+			for (size_t i = 0; i < list.second.size(); i++) {
+				entry const & e = list.second[i];
+				if (!passed(e)) continue;
+				retired.push_back({e.released, {&list.second, i}});
+			}
+		}
+		std::sort(retired.begin(), retired.end(), [](decltype(retired)::value_type const & a, decltype(retired)::value_type const & b){return a.first < b.first;});
+		for (decltype(retired)::value_type const & r : retired) {
+			if (stats_.bytes <= max_bytes && now - r.first <= max_idle) break;
+			entry & e = (*r.second.first)[r.second.second];
+			stats_.buffers--;
+			stats_.bytes -= e.buf->size();
+			doomed.push_back(std::move(e.buf));
+		}
+		for (std::map<key, std::vector<entry>>::iterator iter = entries.begin(); iter != entries.end();) {
+			std::vector<entry> & list = iter->second;
+			list.erase(std::remove_if(list.begin(), list.end(), [](entry const & e){return !e.buf;}), list.end());
+			if (list.empty()) iter = entries.erase(iter);
+			else iter++;
+		}
+	}
+	//destroyed outside the lock, returning their ranges to the heap
+}
+
+void vk::buffer_cache::clear() {
+	trim(0, std::chrono::steady_clock::duration::zero());
+}
+
+vk::buffer_cache::statistics vk::buffer_cache::stats() const {
+	std::lock_guard<std::mutex> lock(mut);
+	return stats_;
+}
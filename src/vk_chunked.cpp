@@ -0,0 +1,79 @@
+#include "vulkanomics.hpp"
+#include "vk_internal.hpp"
+
+static constexpr VkDeviceSize max_default_chunk_size = VkDeviceSize(1) << 30;
+
+vk::chunked_buffer::chunked_buffer(memory_heap & heap, VkDeviceSize size, VkBufferUsageFlags usage, memory_profile profile, VkDeviceSize chunk_size) : parent(heap.parent), size_(size), chunk_size_(chunk_size) {
+	if (!size_) srcthrow("chunked buffer cannot be empty");
+	if (!chunk_size_) {
+		VkPhysicalDeviceLimits const & limits = parent.parent.properties.limits;
+		chunk_size_ = max_default_chunk_size;
+		if (usage & VK_BUFFER_USAGE_STORAGE_BUFFER_BIT) chunk_size_ = std::min<VkDeviceSize>(chunk_size_, limits.maxStorageBufferRange);
+		if (usage & VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT) chunk_size_ = std::min<VkDeviceSize>(chunk_size_, limits.maxUniformBufferRange);
+		if (chunk_size_ > 256) chunk_size_ &= ~VkDeviceSize(255); //keeps common element sizes from straddling chunks
+	}
+	
+	for (VkDeviceSize offset = 0; offset < size_; offset += chunk_size_) {
+		std::unique_ptr<vk::buffer> buf {new vk::buffer {parent, std::min(chunk_size_, size_ - offset), usage}};
+		heap.bind(*buf, profile);
+		chunks.push_back(std::move(buf));
+	}
+}
+
+vk::chunked_buffer::span vk::chunked_buffer::locate(VkDeviceSize offset) const {
+	if (offset >= size_) srcthrow("offset %llu is past the end of a chunked buffer of %llu bytes", static_cast<unsigned long long>(offset), static_cast<unsigned long long>(size_));
+	span s;
+	s.chunk = static_cast<uint32_t>(offset / chunk_size_);
+	s.offset = offset % chunk_size_;
+	s.size = chunks[s.chunk]->size() - s.offset;
+	return s;
+}
+
+std::vector<vk::chunked_buffer::span> vk::chunked_buffer::split(VkDeviceSize offset, VkDeviceSize size) const {
+	if (offset + size > size_) srcthrow("range of %llu bytes at %llu is past the end of a chunked buffer of %llu bytes", static_cast<unsigned long long>(size), static_cast<unsigned long long>(offset), static_cast<unsigned long long>(size_));
+	std::vector<span> spans;
+	while (size) {
+		span s = locate(offset);
+		s.size = std::min(s.size, size);
+		offset += s.size;
+		size -= s.size;
+		spans.push_back(s);
+	}
+	return spans;
+}
+
+vk::descriptor::buffer_info_set vk::chunked_buffer::descript(uint32_t first, uint32_t count) const {
+	if (first > chunks.size()) srcthrow("chunk %u does not exist", first);
+	count = std::min<uint32_t>(count, chunks.size() - first);
+	descriptor::buffer_info_set infos;
+	infos.reserve(count);
+	for (uint32_t i = first; i < first + count; i++) infos.push_back({chunks[i]->handle, 0, VK_WHOLE_SIZE});
+	return infos;
+}
+
+void vk::chunked_buffer::dispatch(command::buffer & cmd, pipeline::layout const & layout, VkShaderStageFlags stages, uint32_t push_offset, VkDeviceSize element_size, uint32_t local_size, uint64_t first, uint64_t count) const {
+	if (!element_size || !local_size) srcthrow("element size and local size must be nonzero");
+	if (chunk_size_ % element_size) srcthrow("chunk size %llu is not a multiple of the element size %llu", static_cast<unsigned long long>(chunk_size_), static_cast<unsigned long long>(element_size));
+	uint64_t chunk_elements = chunk_size_ / element_size;
+	if (chunk_elements > UINT32_MAX) srcthrow("%llu elements per chunk do not fit the 32 bit dispatch constants", static_cast<unsigned long long>(chunk_elements));
+	uint64_t total = size_ / element_size;
+	if (first > total) srcthrow("first element %llu is past the %llu elements of the buffer", static_cast<unsigned long long>(first), static_cast<unsigned long long>(total));
+	count = std::min(count, total - first);
+	
+	uint64_t max_elements = static_cast<uint64_t>(parent.parent.properties.limits.maxComputeWorkGroupCount[0]) * local_size;
+	while (count) {
+		uint64_t in_chunk = first % chunk_elements;
+		uint64_t n = std::min({count, chunk_elements - in_chunk, max_elements});
+		dispatch_constants dc = {
+			.chunk = static_cast<uint32_t>(first / chunk_elements),
+			.first = static_cast<uint32_t>(in_chunk),
+			.count = static_cast<uint32_t>(n),
+			.base_low = static_cast<uint32_t>(first),
+			.base_high = static_cast<uint32_t>(first >> 32),
+		};
+		cmd.push_constants(layout, stages, push_offset, sizeof(dc), &dc);
+		cmd.dispatch(static_cast<uint32_t>((n + local_size - 1) / local_size), 1, 1);
+		first += n;
+		count -= n;
+	}
+}
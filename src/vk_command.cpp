@@ -12,7 +12,26 @@ vk::command::pool::pool(device const & parent, VkCommandPoolCreateFlags flags, u
 }
 
 vk::command::pool::~pool() {
-	if (handle) parent.vkDestroyCommandPool(parent, handle, nullptr);
+	if (!handle) return;
+	if (parent.retirement) parent.retirement->retire_command_pool(handle);
+	else parent.vkDestroyCommandPool(parent, handle, nullptr);
+}
+
+void vk::command::pool::reset(VkCommandPoolResetFlags flags) {
+	if (parent.retirement) parent.retirement->collect_command_pool(handle);
+	VKR(parent.vkResetCommandPool(parent, handle, flags))
+}
+
+void vk::command::pool::allocate(VkCommandBuffer * handles, uint32_t count, VkCommandBufferLevel lev) const {
+	VkCommandBufferAllocateInfo allocate = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+		.pNext = nullptr,
+		.commandPool = handle,
+		.level = lev,
+		.commandBufferCount = count,
+	};
+	if (parent.retirement) parent.retirement->collect_command_pool(handle);
+	VKR(parent.vkAllocateCommandBuffers(parent, &allocate, handles))
 }
 
 vk::command::buffer::buffer(pool const & parent, VkCommandBufferLevel lev) : parent(parent) {
@@ -23,11 +42,16 @@ vk::command::buffer::buffer(pool const & parent, VkCommandBufferLevel lev) : par
 		.level = lev,
 		.commandBufferCount = 1,
 	};
+	if (parent.parent.retirement) parent.parent.retirement->collect_command_pool(parent.handle);
 	VKR(parent.parent.vkAllocateCommandBuffers(parent.parent, &allocate, &handle))
 }
 
+vk::command::buffer::buffer(pool const & parent, VkCommandBuffer handle) : handle(handle), parent(parent), owned(false) {}
+
 vk::command::buffer::~buffer() {
-	if (handle) parent.parent.vkFreeCommandBuffers(parent.parent, parent.handle, 1, &handle);
+	if (!handle || !owned) return;
+	if (parent.parent.retirement) parent.parent.retirement->retire_command_buffer(parent.handle, handle);
+	else parent.parent.vkFreeCommandBuffers(parent.parent, parent.handle, 1, &handle);
 }
 
 void vk::command::buffer::begin(VkCommandBufferUsageFlags flags, VkCommandBufferInheritanceInfo const * inheritance) {
@@ -52,18 +76,261 @@ void vk::command::buffer::bind_graphics_pipeline(graphics_pipeline const & pip)
 	parent.parent.vkCmdBindPipeline(handle, VK_PIPELINE_BIND_POINT_GRAPHICS, pip);
 }
 
-void vk::command::buffer::bind_descriptor_sets(VkPipelineBindPoint bind_point, pipeline::layout & layout, std::vector<descriptor::set const *> const & descriptors) {
-	std::vector<VkDescriptorSet> descs;
+void vk::command::buffer::bind_descriptor_sets(VkPipelineBindPoint bind_point, pipeline::layout const & layout, std::vector<descriptor::set const *> const & descriptors) {
+	inline_vector<VkDescriptorSet, 8> descs;
 	for (descriptor::set const * s : descriptors) {
 		descs.push_back(*s);
 	}
-	parent.parent.vkCmdBindDescriptorSets(handle, bind_point, layout.handle, 0, descs.size(), descs.data(), 0, nullptr);
+	bind_descriptor_sets(bind_point, layout, descs.data(), descs.size());
+}
+
+void vk::command::buffer::bind_descriptor_sets(VkPipelineBindPoint bind_point, pipeline::layout const & layout, VkDescriptorSet const * sets, uint32_t sets_count, uint32_t first_set, uint32_t const * dynamic_offsets, uint32_t dynamic_offsets_count) {
+	parent.parent.vkCmdBindDescriptorSets(handle, bind_point, layout.handle, first_set, sets_count, sets, dynamic_offsets_count, dynamic_offsets);
+}
+
+void vk::command::buffer::execute(VkCommandBuffer const * secondaries, uint32_t count) {
+	parent.parent.vkCmdExecuteCommands(handle, count, secondaries);
+}
+
+void vk::command::buffer::push_constants(pipeline::layout const & layout, VkShaderStageFlags stages, uint32_t offset, uint32_t size, void const * values) {
+	parent.parent.vkCmdPushConstants(handle, layout.handle, stages, offset, size, values);
 }
 
 void vk::command::buffer::dispatch(uint32_t x, uint32_t y, uint32_t z) {
 	parent.parent.vkCmdDispatch(handle, x, y, z);
 }
 
+void vk::command::buffer::draw(uint32_t vertex_count, uint32_t instance_count, uint32_t first_vertex, uint32_t first_instance) {
+	parent.parent.vkCmdDraw(handle, vertex_count, instance_count, first_vertex, first_instance);
+}
+
+void vk::command::buffer::bind_index_buffer(vk::buffer const & buf, VkDeviceSize offset, VkIndexType type) {
+	parent.parent.vkCmdBindIndexBuffer(handle, buf.handle, offset, type);
+}
+
+void vk::command::buffer::dispatch_indirect(vk::buffer const & args, VkDeviceSize offset) {
+	parent.parent.vkCmdDispatchIndirect(handle, args.handle, offset);
+}
+
+void vk::command::buffer::draw_indirect(vk::buffer const & args, VkDeviceSize offset, uint32_t draw_count, uint32_t stride) {
+	parent.parent.vkCmdDrawIndirect(handle, args.handle, offset, draw_count, stride);
+}
+
+void vk::command::buffer::draw_indexed_indirect(vk::buffer const & args, VkDeviceSize offset, uint32_t draw_count, uint32_t stride) {
+	parent.parent.vkCmdDrawIndexedIndirect(handle, args.handle, offset, draw_count, stride);
+}
+
+void vk::command::buffer::draw_indirect_count(vk::buffer const & args, VkDeviceSize offset, vk::buffer const & count_buffer, VkDeviceSize count_offset, uint32_t max_draw_count, uint32_t stride) {
+	#ifdef VK_KHR_draw_indirect_count
+	if (parent.parent.vkCmdDrawIndirectCountKHR) {
+		parent.parent.vkCmdDrawIndirectCountKHR(handle, args.handle, offset, count_buffer.handle, count_offset, max_draw_count, stride);
+		return;
+	}
+	#endif
+	srcthrow("draw_indirect_count requires VK_KHR_draw_indirect_count");
+}
+
+void vk::command::buffer::draw_indexed_indirect_count(vk::buffer const & args, VkDeviceSize offset, vk::buffer const & count_buffer, VkDeviceSize count_offset, uint32_t max_draw_count, uint32_t stride) {
+	#ifdef VK_KHR_draw_indirect_count
+	if (parent.parent.vkCmdDrawIndexedIndirectCountKHR) {
+		parent.parent.vkCmdDrawIndexedIndirectCountKHR(handle, args.handle, offset, count_buffer.handle, count_offset, max_draw_count, stride);
+		return;
+	}
+	#endif
+	srcthrow("draw_indexed_indirect_count requires VK_KHR_draw_indirect_count");
+}
+
+void vk::command::buffer::fill_buffer(vk::buffer & dst, VkDeviceSize offset, VkDeviceSize size, uint32_t data) {
+	parent.parent.vkCmdFillBuffer(handle, dst.handle, offset, size, data);
+}
+
+void vk::command::buffer::indirect_barrier(VkPipelineStageFlags producer_stages, VkAccessFlags producer_access) {
+	VkMemoryBarrier indirect_read = {VK_STRUCTURE_TYPE_MEMORY_BARRIER, nullptr, producer_access, VK_ACCESS_INDIRECT_COMMAND_READ_BIT};
+	barrier(producer_stages, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, &indirect_read, 1, nullptr, 0, nullptr, 0);
+}
+
+//the release makes src_access writes available, the acquire makes them visible; the access of the other side is ignored
+
+void vk::command::buffer::release(vk::buffer const & b, uint32_t src_family, uint32_t dst_family, VkPipelineStageFlags src_stages, VkAccessFlags src_access, VkDeviceSize offset, VkDeviceSize size) {
+	if (src_family == dst_family) return;
+	VkBufferMemoryBarrier bb = {
+		.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+		.pNext = nullptr,
+		.srcAccessMask = src_access,
+		.dstAccessMask = 0,
+		.srcQueueFamilyIndex = src_family,
+		.dstQueueFamilyIndex = dst_family,
+		.buffer = b.handle,
+		.offset = offset,
+		.size = size,
+	};
+	barrier(src_stages, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, nullptr, 0, &bb, 1, nullptr, 0);
+}
+
+void vk::command::buffer::acquire(vk::buffer const & b, uint32_t src_family, uint32_t dst_family, VkPipelineStageFlags dst_stages, VkAccessFlags dst_access, VkDeviceSize offset, VkDeviceSize size) {
+	if (src_family == dst_family) return;
+	VkBufferMemoryBarrier bb = {
+		.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+		.pNext = nullptr,
+		.srcAccessMask = 0,
+		.dstAccessMask = dst_access,
+		.srcQueueFamilyIndex = src_family,
+		.dstQueueFamilyIndex = dst_family,
+		.buffer = b.handle,
+		.offset = offset,
+		.size = size,
+	};
+	barrier(VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dst_stages, nullptr, 0, &bb, 1, nullptr, 0);
+}
+
+static inline VkImageMemoryBarrier ownership_barrier(vk::image const & img, uint32_t src_family, uint32_t dst_family, VkImageLayout old_layout, VkImageLayout new_layout, VkImageSubresourceRange range) {
+	if (!range.aspectMask) range.aspectMask = img.aspects();
+	VkImageMemoryBarrier ib = {
+		.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+		.pNext = nullptr,
+		.srcAccessMask = 0,
+		.dstAccessMask = 0,
+		.oldLayout = old_layout,
+		.newLayout = new_layout,
+		.srcQueueFamilyIndex = src_family,
+		.dstQueueFamilyIndex = dst_family,
+		.image = img,
+		.subresourceRange = range,
+	};
+	return ib;
+}
+
+void vk::command::buffer::release(vk::image const & img, uint32_t src_family, uint32_t dst_family, VkImageLayout old_layout, VkImageLayout new_layout, VkPipelineStageFlags src_stages, VkAccessFlags src_access, VkImageSubresourceRange range) {
+	if (src_family == dst_family) return;
+	VkImageMemoryBarrier ib = ownership_barrier(img, src_family, dst_family, old_layout, new_layout, range);
+	ib.srcAccessMask = src_access;
+	barrier(src_stages, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, nullptr, 0, nullptr, 0, &ib, 1);
+}
+
+void vk::command::buffer::acquire(vk::image & img, uint32_t src_family, uint32_t dst_family, VkImageLayout old_layout, VkImageLayout new_layout, VkPipelineStageFlags src_stages, VkAccessFlags src_access, VkPipelineStageFlags dst_stages, VkAccessFlags dst_access, VkImageSubresourceRange range) {
+	if (src_family == dst_family) {
+		if (old_layout == new_layout) return;
+		src_family = dst_family = VK_QUEUE_FAMILY_IGNORED;
+	} else {
+		//the release on the other family already covers the earlier work
+		src_stages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+		src_access = 0;
+	}
+	VkImageMemoryBarrier ib = ownership_barrier(img, src_family, dst_family, old_layout, new_layout, range);
+	ib.srcAccessMask = src_access;
+	ib.dstAccessMask = dst_access;
+	barrier(src_stages, dst_stages, nullptr, 0, nullptr, 0, &ib, 1);
+	if (!range.baseMipLevel && !range.baseArrayLayer && range.levelCount == VK_REMAINING_MIP_LEVELS && range.layerCount == VK_REMAINING_ARRAY_LAYERS) img.set_layout(new_layout);
+	else img.layout_tracked_ = false;
+}
+
+void vk::command::buffer::copy_buffer(vk::buffer const & src, vk::buffer & dst, VkBufferCopy const * regions, uint32_t regions_count) {
+	parent.parent.vkCmdCopyBuffer(handle, src.handle, dst.handle, regions_count, regions);
+}
+
+void vk::command::buffer::copy_buffer_to_image(vk::buffer const & src, vk::image & dst, VkImageLayout dst_layout, VkBufferImageCopy const * regions, uint32_t regions_count) {
+	parent.parent.vkCmdCopyBufferToImage(handle, src.handle, dst, dst_layout, regions_count, regions);
+}
+
+void vk::command::buffer::copy_image_to_buffer(vk::image const & src, VkImageLayout src_layout, vk::buffer & dst, VkBufferImageCopy const * regions, uint32_t regions_count) {
+	parent.parent.vkCmdCopyImageToBuffer(handle, src, src_layout, dst.handle, regions_count, regions);
+}
+
 void vk::command::buffer::barrier(VkPipelineStageFlags stages_src, VkPipelineStageFlags stages_dst, std::vector<VkMemoryBarrier> const & memb, std::vector<VkBufferMemoryBarrier> const & bmemb, std::vector<VkImageMemoryBarrier> const & imemb, VkDependencyFlags dep) {
-	parent.parent.vkCmdPipelineBarrier(handle, stages_src, stages_dst, dep, memb.size(), memb.data(), bmemb.size(), bmemb.data(), imemb.size(), imemb.data());
+	barrier(stages_src, stages_dst, memb.data(), memb.size(), bmemb.data(), bmemb.size(), imemb.data(), imemb.size(), dep);
+}
+
+void vk::command::buffer::barrier(VkPipelineStageFlags stages_src, VkPipelineStageFlags stages_dst, VkMemoryBarrier const * memb, uint32_t memb_count, VkBufferMemoryBarrier const * bmemb, uint32_t bmemb_count, VkImageMemoryBarrier const * imemb, uint32_t imemb_count, VkDependencyFlags dep) {
+	parent.parent.vkCmdPipelineBarrier(handle, stages_src, stages_dst, dep, memb_count, memb, bmemb_count, bmemb, imemb_count, imemb);
+}
+
+static std::atomic<uint64_t> next_ring_id {0};
+
+vk::command::frame_ring::frame_ring(device const & parent, uint32_t queue_family, uint32_t frames_in_flight, uint32_t batch) : parent(parent), queue_family(queue_family), id(next_ring_id++), batch(batch), fences(frames_in_flight, nullptr) {
+	if (!frames_in_flight) srcthrow("frame ring requires at least one frame");
+	if (!batch) srcthrow("frame ring batch size must be nonzero");
+}
+
+vk::command::frame_ring::~frame_ring() {
+	for (vk::fence const * f : fences) if (f) f->wait();
+}
+
+vk::command::frame_ring::thread_pools & vk::command::frame_ring::local() {
+	thread_local std::vector<std::pair<uint64_t, thread_pools *>> lookup;
+	for (std::pair<uint64_t, thread_pools *> const & l : lookup) if (l.first == id) return *l.second;
+	
+	std::unique_ptr<thread_pools> pools {new thread_pools};
+	for (size_t f = 0; f < fences.size(); f++) pools->emplace_back(new frame_pool {parent, queue_family});
+	thread_pools * tp = pools.get();
+	{
+		std::lock_guard<std::mutex> lock(mut);
+		threads.push_back(std::move(pools));
+	}
+	lookup.emplace_back(id, tp);
+	return *tp;
+}
+
+vk::command::buffer & vk::command::frame_ring::acquire(VkCommandBufferLevel lev) {
+	frame_pool & fp = *local()[frame()];
+	size_t l = lev == VK_COMMAND_BUFFER_LEVEL_PRIMARY ? 0 : 1;
+	std::vector<std::unique_ptr<buffer>> & bufs = fp.buffers[l];
+	if (fp.used[l] == bufs.size()) {
+		std::vector<VkCommandBuffer> handles(batch);
+		fp.cmd_pool.allocate(handles.data(), batch, lev);
+		for (VkCommandBuffer h : handles) bufs.emplace_back(new buffer {fp.cmd_pool, h});
+	}
+	return *bufs[fp.used[l]++];
+}
+
+void vk::command::frame_ring::advance(vk::fence const & frame_done) {
+	uint32_t cur = frame();
+	uint32_t next = (cur + 1) % fences.size();
+	fences[cur] = &frame_done;
+	if (fences[next]) {
+		fences[next]->wait();
+		fences[next] = nullptr;
+		std::lock_guard<std::mutex> lock(mut);
+		for (std::unique_ptr<thread_pools> const & tp : threads) {
+			frame_pool & fp = *(*tp)[next];
+			if (!fp.used[0] && !fp.used[1]) continue;
+			fp.cmd_pool.reset();
+			fp.used[0] = fp.used[1] = 0;
+		}
+	}
+	current.store(next, std::memory_order_release);
+}
+
+void vk::command::frame_ring::record_parallel(job_system & jobs, buffer & primary, size_t count, std::function<void(buffer &, size_t item)> const & record, VkCommandBufferInheritanceInfo const * inheritance, size_t grain) {
+	VkCommandBufferInheritanceInfo outside_render_pass = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+		.pNext = nullptr,
+		.renderPass = VK_NULL_HANDLE,
+		.subpass = 0,
+		.framebuffer = VK_NULL_HANDLE,
+		.occlusionQueryEnable = VK_FALSE,
+		.queryFlags = 0,
+		.pipelineStatistics = 0,
+	};
+	if (!inheritance) inheritance = &outside_render_pass;
+	VkCommandBufferUsageFlags flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	if (inheritance->renderPass != VK_NULL_HANDLE) flags |= VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+	
+	//kept across frames, and the job captures two references so std::function keeps it inline
+	thread_local std::vector<VkCommandBuffer> recorded; //the caller's, tasks reach it through job rather than their own
+	recorded.assign(count, VK_NULL_HANDLE); //at the first item of each task
+	struct {
+		VkCommandBufferUsageFlags flags;
+		VkCommandBufferInheritanceInfo const * inheritance;
+		std::function<void(buffer &, size_t item)> const & record;
+		std::vector<VkCommandBuffer> & recorded;
+	} job {flags, inheritance, record, recorded};
+	jobs.run(count, [this, &job](size_t begin, size_t end, uint32_t){
+		buffer & secondary = acquire(VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+		secondary.begin(job.flags, job.inheritance);
+		for (size_t i = begin; i < end; i++) job.record(secondary, i);
+		secondary.end();
+		job.recorded[begin] = secondary.handle;
+	}, grain);
+	recorded.erase(std::remove(recorded.begin(), recorded.end(), VK_NULL_HANDLE), recorded.end());
+	if (recorded.size()) primary.execute(recorded.data(), recorded.size());
 }
@@ -0,0 +1,97 @@
+#include "vulkanomics.hpp"
+#include "vk_internal.hpp"
+
+vk::fence & vk::fence_pool::acquire() {
+	std::lock_guard<std::mutex> lock(mut);
+	if (available.empty() && !released.empty()) {
+		reset_scratch.clear();
+		for (vk::fence * f : released) reset_scratch.push_back(*f);
+		VKR(parent.vkResetFences(parent, reset_scratch.size(), reset_scratch.data()))
+		available.swap(released);
+	}
+	if (available.empty()) {
+		fences.emplace_back(new vk::fence {parent});
+		return *fences.back();
+	}
+	vk::fence * f = available.back();
+	available.pop_back();
+	return *f;
+}
+
+void vk::fence_pool::release(vk::fence & f) {
+	std::lock_guard<std::mutex> lock(mut);
+	released.push_back(&f);
+}
+
+size_t vk::fence_pool::size() const {
+	std::lock_guard<std::mutex> lock(mut);
+	return fences.size();
+}
+
+vk::completion_dispatcher::completion_dispatcher(device const & parent, fence_pool & pool, std::chrono::microseconds poll_interval) : parent(parent), pool(pool), poll_interval(poll_interval) {
+	thread = std::thread {&completion_dispatcher::dispatch, this};
+}
+
+vk::completion_dispatcher::~completion_dispatcher() {
+	{
+		std::lock_guard<std::mutex> lock(mut);
+		stopping = true;
+	}
+	cv.notify_one();
+	thread.join();
+}
+
+void vk::completion_dispatcher::watch(VkFence f, continuation cb) {
+	outstanding_++;
+	{
+		std::lock_guard<std::mutex> lock(mut);
+		incoming.push_back({f, nullptr, std::move(cb)});
+	}
+	cv.notify_one();
+}
+
+void vk::completion_dispatcher::watch(vk::fence & pooled, continuation cb) {
+	outstanding_++;
+	{
+		std::lock_guard<std::mutex> lock(mut);
+		incoming.push_back({pooled, &pooled, std::move(cb)});
+	}
+	cv.notify_one();
+}
+
+size_t vk::completion_dispatcher::outstanding() const {
+	return outstanding_.load();
+}
+
+void vk::completion_dispatcher::dispatch() {
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(mut);
+			if (watching.empty()) cv.wait(lock, [this](){return !incoming.empty() || stopping;});
+			for (watched & w : incoming) watching.push_back(std::move(w));
+			incoming.clear();
+			if (watching.empty()) return; //stopping with nothing left
+		}
+		
+		handles_scratch.clear();
+		for (watched const & w : watching) handles_scratch.push_back(w.handle);
+		uint64_t timeout = std::chrono::duration_cast<std::chrono::nanoseconds>(poll_interval).count();
+		VkResult res = parent.vkWaitForFences(parent, handles_scratch.size(), handles_scratch.data(), VK_FALSE, timeout);
+		if (res == VK_TIMEOUT) continue;
+		
+		//any one signaled, find out which; a failed wait completes everything with its error
+		for (size_t i = 0; i < watching.size();) {
+			VkResult status = res == VK_SUCCESS ? parent.vkGetFenceStatus(parent, watching[i].handle) : res;
+			if (status == VK_NOT_READY) {
+				i++;
+				continue;
+			}
+			watched w = std::move(watching[i]);
+			watching[i] = std::move(watching.back());
+			watching.pop_back();
+			w.cb(status);
+			if (w.pooled) pool.release(*w.pooled);
+			outstanding_--;
+		}
+	}
+}
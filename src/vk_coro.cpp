@@ -0,0 +1,131 @@
+#ifdef VULKANOMICS_COROUTINES
+
+#include "vulkanomics_coro.hpp"
+#include "vk_internal.hpp"
+
+vk::gpu_executor::gpu_executor(device const & parent, uint32_t workers, std::chrono::microseconds poll_interval) : parent(parent), fences(parent), dispatcher(parent, fences, poll_interval) {
+	if (!workers) srcthrow("gpu executor requires at least one worker");
+	for (uint32_t i = 0; i < workers; i++) threads.emplace_back(&gpu_executor::work, this);
+}
+
+vk::gpu_executor::~gpu_executor() {
+	{
+		std::lock_guard<std::mutex> lock(mut);
+		stopping = true;
+	}
+	cv.notify_all();
+	for (std::thread & t : threads) t.join();
+}
+
+void vk::gpu_executor::post(std::coroutine_handle<> h) {
+	std::lock_guard<std::mutex> lock(mut); //notified under the lock, a resumed coroutine may go on to destroy the executor
+	ready.push_back(h);
+	cv.notify_one();
+}
+
+void vk::gpu_executor::work() {
+	std::unique_lock<std::mutex> lock(mut);
+	for (;;) {
+		cv.wait(lock, [this](){return !ready.empty() || stopping;});
+		if (stopping) return;
+		std::coroutine_handle<> h = ready.front();
+		ready.pop_front();
+		lock.unlock();
+		h.resume();
+		lock.lock();
+	}
+}
+
+VkSemaphore vk::gpu_executor::acquire_semaphore() {
+	std::lock_guard<std::mutex> lock(mut);
+	if (available_semaphores.empty()) {
+		semaphores.emplace_back(new vk::semaphore {parent});
+		return *semaphores.back();
+	}
+	VkSemaphore s = available_semaphores.back();
+	available_semaphores.pop_back();
+	return s;
+}
+
+void vk::gpu_executor::release_semaphore(VkSemaphore s) {
+	std::lock_guard<std::mutex> lock(mut);
+	available_semaphores.push_back(s);
+}
+
+//the awaiter lives in the coroutine frame, which may be resumed and gone as soon as its fence is watched
+
+void vk::gpu_executor::submit_awaiter::await_suspend(std::coroutine_handle<> h) {
+	vk::fence & f = exec.fences.acquire();
+	try {
+		queue.submit(infos, infos_count, f);
+	} catch (...) { //the coroutine resumes with the exception
+		exec.fences.release(f);
+		throw;
+	}
+	gpu_executor & e = exec;
+	e.dispatcher.watch(f, [this, h, &e, &f](VkResult res){
+		result = res;
+		e.fences.release(f);
+		e.post(h);
+	});
+}
+
+void vk::gpu_executor::submit_awaiter::await_resume() const {
+	if (result != VK_SUCCESS) throw vk::exception(strf("VULKANOMICS ERROR: awaited submission failed: (%s)", vk_result_to_str(result)), result);
+}
+
+//the ring signals a semaphore that an empty submit waits on, the fence of that submit tells when the uploads are done
+void vk::gpu_executor::upload_awaiter::await_suspend(std::coroutine_handle<> h) {
+	uploaded = exec.acquire_semaphore();
+	vk::fence & f = exec.fences.acquire();
+	VkPipelineStageFlags stage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+	VkSubmitInfo submit_info = {
+		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+		.pNext = nullptr,
+		.waitSemaphoreCount = 1,
+		.pWaitSemaphores = &uploaded,
+		.pWaitDstStageMask = &stage,
+		.commandBufferCount = 0,
+		.pCommandBuffers = nullptr,
+		.signalSemaphoreCount = 0,
+		.pSignalSemaphores = nullptr,
+	};
+	try {
+		ring.submit(&uploaded, 1);
+		ring.submit_queue().submit(&submit_info, 1, f);
+	} catch (...) { //a semaphore that may have been signaled is not reused
+		exec.fences.release(f);
+		throw;
+	}
+	gpu_executor & e = exec;
+	VkSemaphore s = uploaded;
+	e.dispatcher.watch(f, [this, h, &e, &f, s](VkResult res){
+		result = res;
+		e.fences.release(f);
+		e.release_semaphore(s);
+		e.post(h);
+	});
+}
+
+void vk::gpu_executor::upload_awaiter::await_resume() const {
+	if (result != VK_SUCCESS) throw vk::exception(strf("VULKANOMICS ERROR: awaited upload failed: (%s)", vk_result_to_str(result)), result);
+}
+
+void vk::gpu_executor::read_awaiter::await_suspend(std::coroutine_handle<> h) {
+	gpu_executor & e = exec;
+	readback & r = rb;
+	bool now = submit;
+	r.read(src, offset, size, [this, h, &e](void const * bytes, VkDeviceSize size, std::exception_ptr failure){
+		if (failure) error = failure;
+		else data.assign(reinterpret_cast<uint8_t const *>(bytes), reinterpret_cast<uint8_t const *>(bytes) + size);
+		e.post(h);
+	});
+	if (now) r.submit();
+}
+
+std::vector<uint8_t> vk::gpu_executor::read_awaiter::await_resume() {
+	if (error) std::rethrow_exception(error);
+	return std::move(data);
+}
+
+#endif
@@ -61,7 +61,9 @@ vk::descriptor::pool::pool(device const & parent, pool_size_set const & pool_siz
 }
 
 vk::descriptor::pool::~pool() {
-	if (handle != VK_NULL_HANDLE) parent.vkDestroyDescriptorPool(parent, handle, nullptr);
+	if (handle == VK_NULL_HANDLE) return;
+	if (parent.retirement) parent.retirement->retire_descriptor_pool(handle);
+	else parent.vkDestroyDescriptorPool(parent, handle, nullptr);
 }
 
 vk::descriptor::set::set(pool const & parent, layout const & lay) : parent(parent) {
@@ -72,17 +74,28 @@ vk::descriptor::set::set(pool const & parent, layout const & lay) : parent(paren
 		.descriptorSetCount = 1,
 		.pSetLayouts = &lay.get_handle(),
 	};
+	if (parent.parent.retirement) parent.parent.retirement->collect_descriptor_pool(parent);
 	VKR(parent.parent.vkAllocateDescriptorSets(parent.parent, &allocate, &handle))
 }
 
 vk::descriptor::set::~set() {
-	if (handle != VK_NULL_HANDLE) parent.parent.vkFreeDescriptorSets(parent.parent, parent, 1, &handle);
+	if (handle == VK_NULL_HANDLE) return;
+	if (parent.parent.retirement) parent.parent.retirement->retire_descriptor_set(parent, handle);
+	else parent.parent.vkFreeDescriptorSets(parent.parent, parent, 1, &handle);
 }
 
 void vk::descriptor::update_session::update() {
+	for (size_t i = 0; i < wset.size(); i++) wset[i].pBufferInfo = binfo.data() + wset_info[i];
 	parent.vkUpdateDescriptorSets(parent, wset.size(), wset.data(), cset.size(), cset.data());
 }
 
+void vk::descriptor::update_session::clear() {
+	wset.clear();
+	wset_info.clear();
+	binfo.clear();
+	cset.clear();
+}
+
 void vk::descriptor::update_session::copy(set & src, set & dst, uint32_t src_binding, uint32_t dst_binding, uint32_t count, uint32_t src_index, uint32_t dst_index) {
 	VkCopyDescriptorSet cpyset = {
 		.sType = VK_STRUCTURE_TYPE_COPY_DESCRIPTOR_SET,
@@ -95,21 +108,27 @@ void vk::descriptor::update_session::copy(set & src, set & dst, uint32_t src_bin
 		.dstArrayElement = dst_index,
 		.descriptorCount = count,
 	};
-	cset.push_back(std::move(cpyset));
+	cset.push_back(cpyset);
 }
 
 void vk::descriptor::update_session::write_buffer(set & s, uint32_t binding, uint32_t index, VkDescriptorType type, buffer_info_set const & bi) {
+	write_buffer(s, binding, index, type, bi.data(), bi.size());
+}
+
+void vk::descriptor::update_session::write_buffer(set & s, uint32_t binding, uint32_t index, VkDescriptorType type, VkDescriptorBufferInfo const * infos, uint32_t infos_count) {
+	wset_info.push_back(binfo.size());
+	for (uint32_t i = 0; i < infos_count; i++) binfo.push_back(infos[i]);
 	VkWriteDescriptorSet wrtset = {
 		.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
 		.pNext = nullptr,
 		.dstSet = s,
 		.dstBinding = binding,
 		.dstArrayElement = index,
-		.descriptorCount = static_cast<uint32_t>(bi.size()),
+		.descriptorCount = infos_count,
 		.descriptorType = type,
 		.pImageInfo = nullptr,
-		.pBufferInfo = bi.data(),
+		.pBufferInfo = nullptr, //set in update(), binfo may still move
 		.pTexelBufferView = nullptr,
 	};
-	wset.push_back(std::move(wrtset));
+	wset.push_back(wrtset);
 }
@@ -6,7 +6,19 @@ constexpr uint32_t vk::device::capability::compute;
 constexpr uint32_t vk::device::capability::graphics;
 constexpr uint32_t vk::device::capability::presentable;
 
-vk::device::initializer::initializer(physical_device const & pdev, capability_set const & caps) : parent(pdev) {
+//the capabilities a family offers beyond the requested ones, graphics and compute families can always transfer
+static inline uint32_t family_surplus(VkQueueFlags flags, vk::device::capability::flags requested) {
+	if (flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) flags |= VK_QUEUE_TRANSFER_BIT;
+	uint32_t surplus = 0;
+	if (flags & VK_QUEUE_GRAPHICS_BIT && !(requested & vk::device::capability::graphics)) surplus++;
+	if (flags & VK_QUEUE_COMPUTE_BIT && !(requested & vk::device::capability::compute)) surplus++;
+	if (flags & VK_QUEUE_TRANSFER_BIT && !(requested & vk::device::capability::transfer)) surplus++;
+	return surplus;
+}
+
+vk::device::initializer::initializer(physical_device const & pdev, capability_set const & caps, std::vector<float> const & priorities) : parent(pdev) {
+	if (priorities.size() && priorities.size() != caps.size()) srcthrow("%zu queue priorities given for %zu capabilities", priorities.size(), caps.size());
+	for (float p : priorities) if (p < 0.0f || p > 1.0f) srcthrow("queue priority %f outside of [0, 1]", p);
 	this->create_infos.resize(pdev.queue_families.size());
 	this->queue_priorities.resize(pdev.queue_families.size());
 	this->protoqueues.resize(caps.size());
@@ -20,27 +32,31 @@ vk::device::initializer::initializer(physical_device const & pdev, capability_se
 	
 	for (uint32_t c = 0; c < caps.size(); c++) {
 		
-		bool queue_found = false;
-		
+		//the capable family with spare queues and the least capabilities beyond the requested ones, so transfers land on
+		//dedicated DMA families and compute next to graphics on async compute families; ties go to the least used family
+		uint32_t best = UINT32_MAX;
 		for (uint32_t i = 0; i < pdev.queue_families.size(); i++) {
-			if (caps[c] & capability::graphics && !(pdev.queue_families[i].queueFlags | VK_QUEUE_GRAPHICS_BIT)) continue;
-			if (caps[c] & capability::compute && !(pdev.queue_families[i].queueFlags | VK_QUEUE_COMPUTE_BIT)) continue;
-			if (caps[c] & capability::transfer && !(pdev.queue_families[i].queueFlags | VK_QUEUE_TRANSFER_BIT)) continue;
+			VkQueueFlags flags = pdev.queue_families[i].queueFlags;
+			if (caps[c] & capability::graphics && !(flags & VK_QUEUE_GRAPHICS_BIT)) continue;
+			if (caps[c] & capability::compute && !(flags & VK_QUEUE_COMPUTE_BIT)) continue;
+			if (caps[c] & capability::transfer && !(flags & (VK_QUEUE_TRANSFER_BIT | VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) continue;
 			if (caps[c] & capability::presentable && !pdev.queue_families_presentable[i]) continue;
 			if (create_infos[i].queueCount == pdev.queue_families[i].queueCount) continue;
-			queue_priorities[i].emplace_back(caps[c] == capability::transfer ? 0.5f : 1.0f);
-			protoqueues[c].queue_index = create_infos[i].queueCount++;
-			protoqueues[c].cap_flags = caps[c];
-			protoqueues[c].queue_family = i;
-			queue_found = true;
-			overall_capability |= caps[c];
-			break;
+			if (best != UINT32_MAX) {
+				uint32_t surplus = family_surplus(flags, caps[c]), best_surplus = family_surplus(pdev.queue_families[best].queueFlags, caps[c]);
+				if (surplus > best_surplus) continue;
+				if (surplus == best_surplus && create_infos[i].queueCount >= create_infos[best].queueCount) continue;
+			}
+			best = i;
 		}
 		
-		if (queue_found) continue;
-		
-		srcthrow("could not resolve a queue for requested capability: %u, index %i", caps[c], c);
+		if (best == UINT32_MAX) srcthrow("could not resolve a queue for requested capability: %u, index %i", caps[c], c);
 		
+		queue_priorities[best].emplace_back(priorities.size() ? priorities[c] : caps[c] == capability::transfer ? 0.5f : 1.0f);
+		protoqueues[c].queue_index = create_infos[best].queueCount++;
+		protoqueues[c].cap_flags = caps[c];
+		protoqueues[c].queue_family = best;
+		overall_capability |= caps[c];
 	}
 	
 	for (uint32_t i = 0; i < pdev.queue_families.size(); i++) {
@@ -49,6 +65,41 @@ vk::device::initializer::initializer(physical_device const & pdev, capability_se
 	
 	if (overall_capability & capability::presentable) device_extensions.push_back("VK_KHR_swapchain");
 	
+	//optional extensions, enabled whenever supported
+	#ifdef VK_EXT_memory_budget
+	if (vk::GetPhysicalDeviceMemoryProperties2KHR && pdev.has_extension("VK_EXT_memory_budget")) device_extensions.push_back("VK_EXT_memory_budget");
+	#endif
+	#ifdef VK_KHR_get_memory_requirements2
+	if (pdev.has_extension("VK_KHR_get_memory_requirements2")) {
+		device_extensions.push_back("VK_KHR_get_memory_requirements2");
+		#ifdef VK_KHR_dedicated_allocation
+		if (pdev.has_extension("VK_KHR_dedicated_allocation")) device_extensions.push_back("VK_KHR_dedicated_allocation");
+		#endif
+	}
+	#endif
+	#ifdef VK_KHR_bind_memory2
+	if (pdev.has_extension("VK_KHR_bind_memory2")) device_extensions.push_back("VK_KHR_bind_memory2");
+	#endif
+	#ifdef VK_KHR_draw_indirect_count
+	if (pdev.has_extension("VK_KHR_draw_indirect_count")) device_extensions.push_back("VK_KHR_draw_indirect_count");
+	#endif
+	#ifdef VK_KHR_timeline_semaphore
+	if (vk::GetPhysicalDeviceFeatures2KHR && pdev.has_extension("VK_KHR_timeline_semaphore")) { //the extension alone does not enable the feature
+		VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timeline_features = {
+			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR,
+			.pNext = nullptr,
+			.timelineSemaphore = VK_FALSE,
+		};
+		VkPhysicalDeviceFeatures2KHR features = {
+			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR,
+			.pNext = &timeline_features,
+			.features = {},
+		};
+		vk::GetPhysicalDeviceFeatures2KHR(pdev.handle, &features);
+		if (timeline_features.timelineSemaphore) device_extensions.push_back("VK_KHR_timeline_semaphore");
+	}
+	#endif
+	
 	for (char const * ext : device_extensions) {
 		bool sup = false;
 		for (VkExtensionProperties const & ep : parent.extensions) {
@@ -74,7 +125,7 @@ vk::device::initializer::initializer(physical_device const & pdev, capability_se
 	}
 }
 
-vk::device::device(initializer & ldi) : parent(ldi.parent), overall_capability(ldi.overall_capability), device_extensions(std::move(ldi.device_extensions)), device_layers(std::move(ldi.device_layers)) {
+vk::device::device(initializer & ldi) : parent(ldi.parent), overall_capability(ldi.overall_capability), device_extensions(std::move(ldi.device_extensions)), device_layers(std::move(ldi.device_layers)), budget(*this) {
 	
 	VkDeviceCreateInfo device_create_info = {
 		.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
@@ -89,11 +140,46 @@ vk::device::device(initializer & ldi) : parent(ldi.parent), overall_capability(l
 		.pEnabledFeatures = NULL,
 	};
 	
+	#ifdef VK_KHR_timeline_semaphore
+	VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timeline_features = {
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR,
+		.pNext = nullptr,
+		.timelineSemaphore = VK_TRUE,
+	};
+	if (has_extension("VK_KHR_timeline_semaphore")) device_create_info.pNext = &timeline_features;
+	#endif
+	
 	VKR(vk::CreateDevice(parent.handle, &device_create_info, NULL, &handle))
 	
 	#define VK_FN_SYM_DEVICE
 	#include "vulkanomics_fn.inl"
 	
+	#ifdef VK_KHR_get_memory_requirements2
+	if (!has_extension("VK_KHR_get_memory_requirements2")) {
+		vkGetBufferMemoryRequirements2KHR = nullptr;
+		vkGetImageMemoryRequirements2KHR = nullptr;
+	}
+	#endif
+	#ifdef VK_KHR_bind_memory2
+	if (!has_extension("VK_KHR_bind_memory2")) {
+		vkBindBufferMemory2KHR = nullptr;
+		vkBindImageMemory2KHR = nullptr;
+	}
+	#endif
+	#ifdef VK_KHR_draw_indirect_count
+	if (!has_extension("VK_KHR_draw_indirect_count")) {
+		vkCmdDrawIndirectCountKHR = nullptr;
+		vkCmdDrawIndexedIndirectCountKHR = nullptr;
+	}
+	#endif
+	#ifdef VK_KHR_timeline_semaphore
+	if (!has_extension("VK_KHR_timeline_semaphore")) {
+		vkGetSemaphoreCounterValueKHR = nullptr;
+		vkWaitSemaphoresKHR = nullptr;
+		vkSignalSemaphoreKHR = nullptr;
+	}
+	#endif
+	
 	if (overall_capability & capability::presentable) {
 		#define VK_FN_SYM_SWAPCHAIN
 		#include "vulkanomics_fn.inl"
@@ -106,6 +192,13 @@ vk::device::device(initializer & ldi) : parent(ldi.parent), overall_capability(l
 		queues[i].cap_flags = ldi.protoqueues[i].cap_flags;
 		queues[i].queue_family = ldi.protoqueues[i].queue_family;
 	}
+	
+	budget.refresh();
+}
+
+bool vk::device::has_extension(char const * name) const {
+	for (char const * ext : device_extensions) if (!strcmp(ext, name)) return true;
+	return false;
 }
 
 vk::device::~device() {
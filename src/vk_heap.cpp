@@ -0,0 +1,429 @@
+#include "vulkanomics.hpp"
+#include "vk_internal.hpp"
+
+/*
+	Two-level segregated fit (TLSF) suballocation. Free ranges of a block are binned by size:
+	the first level is the power of two of the size, the second level splits each power of two
+	into sl_count linear steps. A bitmap per level makes finding a fitting bin O(1), and ranges
+	keep their physical neighbors so a freed range coalesces with free neighbors immediately.
+*/
+
+static constexpr uint32_t sl_log2 = 4;
+static constexpr uint32_t sl_count = 1 << sl_log2;
+static constexpr uint32_t small_log2 = 8; //sizes below 1 << small_log2 share the first level
+static constexpr uint32_t fl_count = 64 - small_log2 + 1;
+static constexpr uint32_t nil = UINT32_MAX;
+
+static constexpr VkDeviceSize small_heap_size = VkDeviceSize(1) << 30;
+static constexpr VkDeviceSize large_heap_block_size = VkDeviceSize(256) << 20;
+
+static inline uint32_t log2_floor(VkDeviceSize v) {
+	return 63 - __builtin_clzll(v);
+}
+
+static inline void bin_of(VkDeviceSize size, uint32_t & fl, uint32_t & sl) {
+	if (size < (VkDeviceSize(1) << small_log2)) {
+		fl = 0;
+		sl = static_cast<uint32_t>(size >> (small_log2 - sl_log2));
+	} else {
+		uint32_t l = log2_floor(size);
+		fl = l - small_log2 + 1;
+		sl = static_cast<uint32_t>(size >> (l - sl_log2)) ^ sl_count;
+	}
+}
+
+//rounds a request up to the next bin boundary, so that every range of the resulting bin fits it
+static inline VkDeviceSize bin_round(VkDeviceSize size) {
+	if (size < (VkDeviceSize(1) << small_log2)) return size + (VkDeviceSize(1) << (small_log2 - sl_log2)) - 1;
+	return size + (VkDeviceSize(1) << (log2_floor(size) - sl_log2)) - 1;
+}
+
+struct vk::memory_heap::block {
+
+	struct range {
+		VkDeviceSize offset;
+		VkDeviceSize size;
+		uint32_t prev_phys, next_phys;
+		uint32_t prev_free, next_free;
+		bool free;
+		vk::memory_bound_structure * owner; //of live ranges bound through memory_heap::bind
+	};
+
+	vk::memory mem;
+	VkDeviceSize used = 0;
+
+	block(device const & parent, uint32_t mem_type, VkDeviceSize size) : mem(parent, mem_type, size) {
+		std::fill(&heads[0][0], &heads[0][0] + fl_count * sl_count, nil);
+		insert_free(new_range(0, size, nil, nil));
+	}
+
+	VkDeviceSize offset_of(uint32_t r) const { return ranges[r].offset; }
+	VkDeviceSize size_of(uint32_t r) const { return ranges[r].size; }
+	void set_owner(uint32_t r, vk::memory_bound_structure * s) { ranges[r].owner = s; }
+	
+	template <typename F> void for_each_owned(F && f) const {
+		for (uint32_t r = 0; r < ranges.size(); r++) if (!ranges[r].free && ranges[r].owner) f(r, ranges[r].owner);
+	}
+
+	uint32_t allocate(VkDeviceSize size, VkDeviceSize alignment) {
+		uint32_t f = find_free(size + alignment - 1);
+		if (f == nil) { //the bin holding size itself is skipped by the search, but may still have a fitting range
+			uint32_t fl, sl;
+			bin_of(size, fl, sl);
+			for (uint32_t c = heads[fl][sl]; c != nil; c = ranges[c].next_free) {
+				if (next_alignment(ranges[c].offset, alignment) + size <= ranges[c].offset + ranges[c].size) {
+					f = c;
+					break;
+				}
+			}
+			if (f == nil) return nil;
+		}
+		remove_free(f);
+
+		VkDeviceSize pad = next_alignment(ranges[f].offset, alignment) - ranges[f].offset;
+		if (pad) {
+			uint32_t p = new_range(ranges[f].offset, pad, ranges[f].prev_phys, f);
+			if (ranges[p].prev_phys != nil) ranges[ranges[p].prev_phys].next_phys = p;
+			ranges[f].prev_phys = p;
+			ranges[f].offset += pad;
+			ranges[f].size -= pad;
+			insert_free(p);
+		}
+		if (ranges[f].size > size) {
+			uint32_t t = new_range(ranges[f].offset + size, ranges[f].size - size, f, ranges[f].next_phys);
+			if (ranges[t].next_phys != nil) ranges[ranges[t].next_phys].prev_phys = t;
+			ranges[f].next_phys = t;
+			ranges[f].size = size;
+			insert_free(t);
+		}
+
+		ranges[f].free = false;
+		used += size;
+		return f;
+	}
+
+	void free(uint32_t r) {
+		assert(!ranges[r].free);
+		used -= ranges[r].size;
+		ranges[r].owner = nullptr;
+		uint32_t p = ranges[r].prev_phys;
+		if (p != nil && ranges[p].free) {
+			remove_free(p);
+			ranges[p].size += ranges[r].size;
+			unlink_phys(r);
+			r = p;
+		}
+		uint32_t n = ranges[r].next_phys;
+		if (n != nil && ranges[n].free) {
+			remove_free(n);
+			ranges[r].size += ranges[n].size;
+			unlink_phys(n);
+		}
+		insert_free(r);
+	}
+
+private:
+	std::vector<range> ranges;
+	std::vector<uint32_t> spare;
+	uint32_t heads[fl_count][sl_count];
+	uint64_t fl_bitmap = 0;
+	uint32_t sl_bitmap[fl_count] {};
+
+	uint32_t new_range(VkDeviceSize offset, VkDeviceSize size, uint32_t prev, uint32_t next) {
+		range r {offset, size, prev, next, nil, nil, true, nullptr};
+		if (spare.size()) {
+			uint32_t i = spare.back();
+			spare.pop_back();
+			ranges[i] = r;
+			return i;
+		}
+		ranges.push_back(r);
+		return static_cast<uint32_t>(ranges.size() - 1);
+	}
+
+	//removes a range that has been merged into its previous physical neighbor
+	void unlink_phys(uint32_t r) {
+		uint32_t p = ranges[r].prev_phys, n = ranges[r].next_phys;
+		if (p != nil) ranges[p].next_phys = n;
+		if (n != nil) ranges[n].prev_phys = p;
+		ranges[r].free = true;
+		spare.push_back(r);
+	}
+
+	void insert_free(uint32_t r) {
+		uint32_t fl, sl;
+		bin_of(ranges[r].size, fl, sl);
+		ranges[r].free = true;
+		ranges[r].prev_free = nil;
+		ranges[r].next_free = heads[fl][sl];
+		if (heads[fl][sl] != nil) ranges[heads[fl][sl]].prev_free = r;
+		heads[fl][sl] = r;
+		fl_bitmap |= uint64_t(1) << fl;
+		sl_bitmap[fl] |= 1u << sl;
+	}
+
+	void remove_free(uint32_t r) {
+		uint32_t fl, sl;
+		bin_of(ranges[r].size, fl, sl);
+		if (ranges[r].prev_free != nil) ranges[ranges[r].prev_free].next_free = ranges[r].next_free;
+		if (ranges[r].next_free != nil) ranges[ranges[r].next_free].prev_free = ranges[r].prev_free;
+		if (heads[fl][sl] == r) {
+			heads[fl][sl] = ranges[r].next_free;
+			if (heads[fl][sl] == nil) {
+				sl_bitmap[fl] &= ~(1u << sl);
+				if (!sl_bitmap[fl]) fl_bitmap &= ~(uint64_t(1) << fl);
+			}
+		}
+	}
+
+	uint32_t find_free(VkDeviceSize size) const {
+		uint32_t fl, sl;
+		bin_of(bin_round(size), fl, sl);
+		if (fl >= fl_count) return nil;
+		uint32_t sl_map = sl_bitmap[fl] & (~0u << sl);
+		if (!sl_map) {
+			uint64_t fl_map = fl + 1 < fl_count ? fl_bitmap & (~uint64_t(0) << (fl + 1)) : 0;
+			if (!fl_map) return nil;
+			fl = __builtin_ctzll(fl_map);
+			sl_map = sl_bitmap[fl];
+		}
+		return heads[fl][__builtin_ctz(sl_map)];
+	}
+};
+
+static inline void placement(vk::device const & parent, VkMemoryRequirements const & req, bool linear, VkDeviceSize & size, VkDeviceSize & alignment) {
+	alignment = std::max<VkDeviceSize>(req.alignment, 1);
+	size = std::max<VkDeviceSize>(req.size, 1);
+	if (!linear) { //occupying whole granularity pages keeps linear neighbors off the pages of this resource
+		VkDeviceSize granularity = parent.parent.properties.limits.bufferImageGranularity;
+		alignment = std::max(alignment, granularity);
+		size = next_alignment(size, granularity);
+	}
+}
+
+vk::memory_heap::memory_heap(device const & parent, VkDeviceSize block_size) : parent(parent), block_size_(block_size) {}
+
+vk::memory_heap::~memory_heap() {
+	if (parent.retirement) parent.retirement->forget(this);
+}
+
+VkDeviceSize vk::memory_heap::block_size(uint32_t mem_type) const {
+	if (block_size_) return block_size_;
+	VkPhysicalDeviceMemoryProperties const & props = parent.parent.memory_properties;
+	VkDeviceSize heap_size = props.memoryHeaps[props.memoryTypes[mem_type].heapIndex].size;
+	return heap_size <= small_heap_size ? heap_size / 8 : large_heap_block_size;
+}
+
+size_t vk::memory_heap::block_count(uint32_t mem_type) const {
+	std::lock_guard<std::mutex> lock(mut);
+	return blocks[mem_type].size();
+}
+
+vk::memory_allocation vk::memory_heap::allocate(VkMemoryRequirements const & req, uint32_t mem_type, bool linear) {
+	if (mem_type >= parent.parent.memory_properties.memoryTypeCount || !(req.memoryTypeBits & (1u << mem_type))) srcthrow("memory type %u not permitted by memoryTypeBits 0x%X", mem_type, req.memoryTypeBits);
+
+	VkDeviceSize size, alignment;
+	placement(parent, req, linear, size, alignment);
+
+	std::lock_guard<std::mutex> lock(mut);
+	block * blk = nullptr;
+	uint32_t r = nil;
+	for (std::unique_ptr<block> & b : blocks[mem_type]) {
+		r = b->allocate(size, alignment);
+		if (r != nil) {
+			blk = b.get();
+			break;
+		}
+	}
+	if (!blk) {
+		blocks[mem_type].emplace_back(new block {parent, mem_type, std::max(block_size(mem_type), size)});
+		blk = blocks[mem_type].back().get();
+		r = blk->allocate(size, alignment);
+		if (r == nil) {
+			blocks[mem_type].pop_back();
+			srcthrow("allocation of %llu bytes aligned to %llu does not fit a new block of memory type %u", static_cast<unsigned long long>(size), static_cast<unsigned long long>(alignment), mem_type);
+		}
+	}
+
+	memory_allocation a;
+	a.block = &blk->mem;
+	a.offset = blk->offset_of(r);
+	a.size = blk->size_of(r);
+	a.heap = this;
+	a.node = r;
+	return a;
+}
+
+void vk::memory_heap::free(memory_allocation & a) {
+	if (!a) return;
+	if (a.heap != this) srcthrow("allocation does not belong to this heap");
+	std::unique_ptr<memory> released; //destroyed after the lock is released
+	std::lock_guard<std::mutex> lock(mut);
+	if (a.node == dedicated_node) {
+		std::vector<std::unique_ptr<memory>>::iterator iter = std::find_if(dedicated.begin(), dedicated.end(), [&a](std::unique_ptr<memory> const & m){return m.get() == a.block;});
+		if (iter == dedicated.end()) srcthrow("allocation refers to a dedicated memory no longer owned by this heap");
+		released = std::move(*iter);
+		dedicated.erase(iter);
+		a = {};
+		return;
+	}
+	std::vector<std::unique_ptr<block>> & type_blocks = blocks[a.block->memory_type()];
+	std::vector<std::unique_ptr<block>>::iterator iter = std::find_if(type_blocks.begin(), type_blocks.end(), [&a](std::unique_ptr<block> const & b){return &b->mem == a.block;});
+	if (iter == type_blocks.end()) srcthrow("allocation refers to a block no longer owned by this heap");
+	(*iter)->free(a.node);
+	a = {};
+	if ((*iter)->used) return;
+	//keep one empty block per type around for reuse, release any others
+	if (std::count_if(type_blocks.begin(), type_blocks.end(), [](std::unique_ptr<block> const & b){return b->used == 0;}) > 1) type_blocks.erase(iter);
+}
+
+vk::memory_allocation vk::memory_heap::allocate(VkMemoryRequirements const & req, memory_profile profile, bool linear) {
+	uint32_t type_bits = req.memoryTypeBits;
+	for (;;) {
+		uint32_t mem_type = parent.parent.find_memory(profile, type_bits);
+		try {
+			return allocate(req, mem_type, linear);
+		} catch (vk::exception & e) {
+			type_bits &= ~(1u << mem_type);
+			if (e.result != VK_ERROR_OUT_OF_DEVICE_MEMORY || !(type_bits & parent.parent.memory_type_mask(profile))) throw;
+		}
+	}
+}
+
+void vk::memory_heap::bind(memory_bound_structure & s, uint32_t mem_type) {
+	if (s.is_bound()) srcthrow("structure is already bound to memory");
+	VkMemoryRequirements req = s.memory_requirements();
+	if (req.size > block_size(mem_type) / 2 || s.dedicated_allocation() != memory_bound_structure::dedication::none) {
+		std::unique_ptr<memory> m;
+		if (vk::buffer * b = dynamic_cast<vk::buffer *>(&s)) m.reset(new memory {parent, mem_type, *b});
+		else if (vk::image * img = dynamic_cast<vk::image *>(&s)) m.reset(new memory {parent, mem_type, *img});
+		if (m) {
+			s.allocation_.block = m.get();
+			s.allocation_.offset = 0;
+			s.allocation_.size = m->size();
+			s.allocation_.heap = this;
+			s.allocation_.node = dedicated_node;
+			std::lock_guard<std::mutex> lock(mut);
+			dedicated.push_back(std::move(m));
+			return;
+		}
+	}
+	memory_allocation a = allocate(req, mem_type, s.linear());
+	adopt(s, a);
+}
+
+void vk::memory_heap::bind(memory_bound_structure & s, memory_profile profile) {
+	uint32_t type_bits = s.memory_requirements().memoryTypeBits;
+	for (;;) {
+		uint32_t mem_type = parent.parent.find_memory(profile, type_bits);
+		try {
+			bind(s, mem_type);
+			return;
+		} catch (vk::exception & e) {
+			type_bits &= ~(1u << mem_type);
+			if (e.result != VK_ERROR_OUT_OF_DEVICE_MEMORY || !(type_bits & parent.parent.memory_type_mask(profile))) throw;
+		}
+	}
+}
+
+void vk::memory_heap::adopt(memory_bound_structure & s, memory_allocation & a) {
+	try {
+		s.bind_to_memory(a.offset, *a.block);
+	} catch (vk::exception &) {
+		free(a);
+		throw;
+	}
+	s.allocation_ = a;
+	std::lock_guard<std::mutex> lock(mut);
+	find_block(a.block)->set_owner(a.node, &s);
+}
+
+vk::memory_heap::block * vk::memory_heap::find_block(memory const * mem) {
+	for (std::unique_ptr<block> & b : blocks[mem->memory_type()]) if (&b->mem == mem) return b.get();
+	srcthrow("memory is not a block of this heap");
+}
+
+vk::memory_heap::defrag_pass vk::memory_heap::defragment(command::buffer & cmd, VkDeviceSize max_bytes, move_callback const & on_move) {
+	struct move {
+		memory_bound_structure * s;
+		block * dst;
+		uint32_t node;
+		memory_allocation vacated;
+	};
+	std::vector<move> moves;
+	defrag_pass pass {*this};
+	
+	std::unique_lock<std::mutex> lock(mut);
+	for (uint32_t t = 0; t < VK_MAX_MEMORY_TYPES; t++) {
+		//evacuate the sparsest blocks first, only ever into denser ones so that moves always make progress
+		std::vector<block *> order;
+		for (std::unique_ptr<block> & b : blocks[t]) if (b->used) order.push_back(b.get());
+		std::sort(order.begin(), order.end(), [](block const * a, block const * b){return a->used < b->used;});
+		for (size_t i = 0; i + 1 < order.size() && pass.bytes < max_bytes; i++) {
+			order[i]->for_each_owned([&](uint32_t r, memory_bound_structure * s){
+				VkDeviceSize size = order[i]->size_of(r);
+				if (pass.bytes + size > max_bytes || !s->movable()) return;
+				VkDeviceSize alignment;
+				placement(parent, s->memory_requirements(), s->linear(), size, alignment);
+				for (size_t j = order.size() - 1; j > i; j--) {
+					uint32_t n = order[j]->allocate(size, alignment);
+					if (n == nil) continue;
+					memory_allocation vacated = s->allocation_;
+					moves.push_back({s, order[j], n, vacated});
+					pass.bytes += size;
+					return;
+				}
+			});
+		}
+	}
+	if (moves.empty()) return pass;
+	
+	VkMemoryBarrier before = {VK_STRUCTURE_TYPE_MEMORY_BARRIER, nullptr, VK_ACCESS_MEMORY_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT};
+	parent.vkCmdPipelineBarrier(cmd.handle, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &before, 0, nullptr, 0, nullptr);
+	std::vector<memory_bound_structure *> moved;
+	for (move & m : moves) {
+		std::function<void(retirement_queue *)> release;
+		try {
+			release = m.s->move_to(cmd, m.dst->mem, m.dst->offset_of(m.node));
+		} catch (vk::exception &) {
+			m.dst->free(m.node);
+			pass.bytes -= m.vacated.size;
+			continue;
+		}
+		m.s->allocation_.block = &m.dst->mem;
+		m.s->allocation_.offset = m.dst->offset_of(m.node);
+		m.s->allocation_.node = m.node;
+		m.dst->set_owner(m.node, m.s);
+		find_block(m.vacated.block)->set_owner(m.vacated.node, nullptr); //no longer a candidate for the next pass
+		pass.moved.push_back({m.vacated, std::move(release)});
+		moved.push_back(m.s);
+	}
+	VkMemoryBarrier after = {VK_STRUCTURE_TYPE_MEMORY_BARRIER, nullptr, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT};
+	parent.vkCmdPipelineBarrier(cmd.handle, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 1, &after, 0, nullptr, 0, nullptr);
+	lock.unlock();
+	
+	if (on_move) for (memory_bound_structure * s : moved) on_move(*s);
+	return pass;
+}
+
+void vk::memory_heap::defrag_pass::finish() {
+	for (move & m : moved) {
+		m.release(nullptr);
+		heap->free(m.vacated);
+	}
+	moved.clear();
+}
+
+vk::memory_heap::defrag_pass::~defrag_pass() {
+	if (moved.empty()) return;
+	//the copies may not even be submitted yet, freeing here would let them read reused memory
+	retirement_queue * retirement = heap->parent.retirement;
+	if (!retirement) {
+		srcprintf_debug("defrag pass of %zu moves destroyed unfinished, their old handles and ranges are leaked", moved.size());
+		return;
+	}
+	for (move & m : moved) {
+		m.release(retirement);
+		retirement->retire_allocation(m.vacated);
+	}
+}
@@ -2,6 +2,7 @@
 #include "vk_internal.hpp"
 
 #include <dlfcn.h>
+#include <array>
 
 //================================================================
 #define VK_FN_IDECL
@@ -11,6 +12,12 @@
 static void * vk_handle = nullptr;
 VkInstance vk_instance = VK_NULL_HANDLE;
 static std::vector<vk::physical_device> physical_devices {};
+static std::vector<char const *> enabled_instance_extensions {};
+
+//enabled when supported, the features depending on them fall back otherwise
+static char const * const optional_instance_extensions[] = {
+	"VK_KHR_get_physical_device_properties2",
+};
 
 //================================================================
 VkSurfaceKHR vk::surface::handle = VK_NULL_HANDLE;
@@ -41,6 +48,14 @@ static void vk_instance_init(std::vector<char const *> & instance_extensions, st
 		}
 		if (!c) srcthrow("required extension \"%s\" unsupported", ext);
 	}
+	for (char const * ext : optional_instance_extensions) {
+		for (VkExtensionProperties const & ep : supext) {
+			if (!strcmp(ext, ep.extensionName)) {
+				instance_extensions.push_back(ext);
+				break;
+			}
+		}
+	}
 	
 	uint32_t suplay_cnt;
 	VKR(vk::EnumerateInstanceLayerProperties(&suplay_cnt, nullptr))
@@ -78,8 +93,27 @@ static void vk_instance_init(std::vector<char const *> & instance_extensions, st
 	
 	VKR(vk::CreateInstance(&instance_create_info, nullptr, &vk_instance))
 	
+	enabled_instance_extensions = instance_extensions;
+	
 	#define VK_FN_SYM_INSTANCE
 	#include "vulkanomics_fn.inl"
+	
+	#ifdef VK_KHR_get_physical_device_properties2
+	if (!vk::instance::has_extension("VK_KHR_get_physical_device_properties2")) {
+		vk::GetPhysicalDeviceMemoryProperties2KHR = nullptr;
+		vk::GetPhysicalDeviceFeatures2KHR = nullptr;
+	}
+	#endif
+}
+
+bool vk::instance::has_extension(char const * name) {
+	for (char const * ext : enabled_instance_extensions) if (!strcmp(ext, name)) return true;
+	return false;
+}
+
+bool vk::physical_device::has_extension(char const * name) const {
+	for (VkExtensionProperties const & ep : extensions) if (!strcmp(ep.extensionName, name)) return true;
+	return false;
 }
 
 static void vk_physical_devices_init() {
@@ -147,6 +181,7 @@ void vk::instance::term() noexcept {
 	if (vk_instance) {
 		DestroyInstance(vk_instance, nullptr);
 		vk_instance = VK_NULL_HANDLE;
+		enabled_instance_extensions.clear();
 	}
 	if (vk_handle) {
 		dlclose(vk_handle);
@@ -167,6 +202,7 @@ vk::physical_device::physical_device(VkPhysicalDevice & handle) : handle(handle)
 	this->queue_families.resize(num);
 	GetPhysicalDeviceQueueFamilyProperties(handle, &num, this->queue_families.data());
 	GetPhysicalDeviceMemoryProperties(handle, &this->memory_properties);
+	build_memory_policies();
 	
 	this->queue_families_presentable.resize(num);
 	if (surface::handle) {
@@ -176,80 +212,92 @@ vk::physical_device::physical_device(VkPhysicalDevice & handle) : handle(handle)
 	}
 }
 
-uint32_t vk::physical_device::find_staging_memory(uint32_t restrict_mask) const {
-	uint32_t index = UINT32_MAX;
+/*
+	The preference of a memory type under a profile, as criteria compared in order, larger is preferred.
+	Returns false for types the profile cannot use at all.
+*/
+typedef std::array<VkDeviceSize, 5> memory_preference;
+static bool memory_type_preference(vk::memory_profile profile, VkPhysicalDeviceMemoryProperties const & props, uint32_t type, memory_preference & pref) {
+	VkMemoryPropertyFlags flags = props.memoryTypes[type].propertyFlags;
+	VkMemoryHeap const & heap = props.memoryHeaps[props.memoryTypes[type].heapIndex];
+	VkDeviceSize device_local = (flags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) != 0;
+	VkDeviceSize heap_device_local = (heap.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+	VkDeviceSize host_visible = (flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0;
+	VkDeviceSize host_coherent = (flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+	VkDeviceSize host_cached = (flags & VK_MEMORY_PROPERTY_HOST_CACHED_BIT) != 0;
+	VkDeviceSize lazy = (flags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) != 0;
 	
-	for (uint32_t mi = 0, ri = 0; mi < memory_properties.memoryTypeCount; mi++) {
-		ri = 1 << mi;
-		if (!(ri & restrict_mask) || !(memory_properties.memoryTypes[mi].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)) continue;
-		else if (index == UINT32_MAX) index = mi;
-		
-		do {
-			if (memory_properties.memoryHeaps[memory_properties.memoryTypes[mi].heapIndex].size != memory_properties.memoryHeaps[memory_properties.memoryTypes[index].heapIndex].size) {
-				if (memory_properties.memoryHeaps[memory_properties.memoryTypes[mi].heapIndex].size > memory_properties.memoryHeaps[memory_properties.memoryTypes[index].heapIndex].size) index = mi;
-				break;
-			}
-			if ((memory_properties.memoryTypes[mi].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) != (memory_properties.memoryTypes[index].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)) {
-				if (memory_properties.memoryTypes[mi].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) index = mi;
-				break;
-			}
-			if ((memory_properties.memoryTypes[mi].propertyFlags & VK_MEMORY_PROPERTY_HOST_CACHED_BIT) != (memory_properties.memoryTypes[index].propertyFlags & VK_MEMORY_PROPERTY_HOST_CACHED_BIT)) {
-				if (memory_properties.memoryTypes[mi].propertyFlags & VK_MEMORY_PROPERTY_HOST_CACHED_BIT) index = mi;
-				break;
-			}
-			if ((memory_properties.memoryTypes[mi].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != (memory_properties.memoryTypes[index].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) {
-				if (memory_properties.memoryTypes[mi].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) index = mi;
-				break;
-			}
-			if ((memory_properties.memoryHeaps[memory_properties.memoryTypes[mi].heapIndex].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != (memory_properties.memoryHeaps[memory_properties.memoryTypes[index].heapIndex].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)) {
-				if (memory_properties.memoryHeaps[memory_properties.memoryTypes[mi].heapIndex].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) index = mi;
-				break;
-			}
-		} while(0);
+	switch (profile) {
+		case vk::memory_profile::gpu_only:
+			pref = {heap_device_local, device_local, !lazy, !host_visible, heap.size};
+			return true;
+		case vk::memory_profile::cpu_to_gpu:
+			pref = {heap.size, device_local, host_cached, host_coherent, heap_device_local};
+			return host_visible;
+		case vk::memory_profile::gpu_to_cpu:
+			pref = {host_cached, host_coherent, !device_local, heap.size, 0};
+			return host_visible;
+		case vk::memory_profile::cpu_only:
+			pref = {!device_local, !heap_device_local, host_coherent, host_cached, heap.size};
+			return host_visible;
+		case vk::memory_profile::transient:
+			pref = {lazy, heap_device_local, device_local, !host_visible, heap.size};
+			return true;
 	}
-	if (index == UINT32_MAX) srcthrow("memory index requirements could not be satisfied");
-	return index;
+	return false;
 }
 
-uint32_t vk::physical_device::find_device_memory(uint32_t restrict_mask) const {
-	uint32_t index = UINT32_MAX;
-	
-	for (uint32_t mi = 0, ri = 0; mi < memory_properties.memoryTypeCount; mi++) {
-		ri = 1 << mi;
-		if (!(ri & restrict_mask)) continue;
-		else if (index == UINT32_MAX) index = mi;
+void vk::physical_device::build_memory_policies() {
+	for (uint32_t p = 0; p < memory_profile_count; p++) {
+		memory_policy & policy = memory_policies[p];
+		std::vector<uint32_t> order;
+		std::vector<memory_preference> prefs(memory_properties.memoryTypeCount);
+		for (uint32_t mi = 0; mi < memory_properties.memoryTypeCount; mi++) {
+			if (memory_type_preference(static_cast<memory_profile>(p), memory_properties, mi, prefs[mi])) order.push_back(mi);
+		}
+		std::stable_sort(order.begin(), order.end(), [&prefs](uint32_t a, uint32_t b){return prefs[a] > prefs[b];});
 		
-		do {
-			if ((memory_properties.memoryHeaps[memory_properties.memoryTypes[mi].heapIndex].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != (memory_properties.memoryHeaps[memory_properties.memoryTypes[index].heapIndex].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)) {
-				if (memory_properties.memoryHeaps[memory_properties.memoryTypes[mi].heapIndex].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) index = mi;
-				break;
-			}
-			if ((memory_properties.memoryTypes[mi].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) != (memory_properties.memoryTypes[index].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)) {
-				if (memory_properties.memoryTypes[mi].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) index = mi;
-				break;
-			}
-			if (memory_properties.memoryHeaps[memory_properties.memoryTypes[mi].heapIndex].size != memory_properties.memoryHeaps[memory_properties.memoryTypes[index].heapIndex].size) {
-				if (memory_properties.memoryHeaps[memory_properties.memoryTypes[mi].heapIndex].size > memory_properties.memoryHeaps[memory_properties.memoryTypes[index].heapIndex].size) index = mi;
-				break;
-			}
-			if ((memory_properties.memoryTypes[mi].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != (memory_properties.memoryTypes[index].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)) {
-				if (memory_properties.memoryTypes[mi].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) index = mi;
-				break;
-			}
-			if ((memory_properties.memoryTypes[mi].propertyFlags & VK_MEMORY_PROPERTY_HOST_CACHED_BIT) != (memory_properties.memoryTypes[index].propertyFlags & VK_MEMORY_PROPERTY_HOST_CACHED_BIT)) {
-				if (memory_properties.memoryTypes[mi].propertyFlags & VK_MEMORY_PROPERTY_HOST_CACHED_BIT) index = mi;
-				break;
-			}
-			if ((memory_properties.memoryTypes[mi].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != (memory_properties.memoryTypes[index].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) {
-				if (memory_properties.memoryTypes[mi].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) index = mi;
-				break;
+		policy.mask = 0;
+		std::fill(policy.rank, policy.rank + VK_MAX_MEMORY_TYPES, UINT8_MAX);
+		for (uint32_t r = 0; r < order.size(); r++) {
+			policy.rank[order[r]] = r;
+			policy.mask |= 1u << order[r];
+		}
+		for (uint32_t c = 0; c < 4; c++) for (uint32_t bits = 0; bits < 256; bits++) {
+			uint8_t best = UINT8_MAX;
+			for (uint32_t b = 0; b < 8; b++) {
+				uint32_t mi = c * 8 + b;
+				if (!(bits & (1u << b)) || policy.rank[mi] == UINT8_MAX) continue;
+				if (best == UINT8_MAX || policy.rank[mi] < policy.rank[best]) best = mi;
 			}
-		} while(0);
+			policy.best[c][bits] = best;
+		}
 	}
-	if (index == UINT32_MAX) srcthrow("memory index requirements could not be satisfied");
+}
+
+uint32_t vk::physical_device::find_memory(memory_profile profile, uint32_t restrict_mask) const {
+	memory_policy const & policy = memory_policies[static_cast<uint32_t>(profile)];
+	uint32_t index = UINT8_MAX;
+	for (uint32_t c = 0; c < 4; c++) {
+		uint8_t mi = policy.best[c][(restrict_mask >> (c * 8)) & 0xFF];
+		if (mi != UINT8_MAX && (index == UINT8_MAX || policy.rank[mi] < policy.rank[index])) index = mi;
+	}
+	if (index == UINT8_MAX) srcthrow("memory index requirements could not be satisfied");
 	return index;
 }
 
+uint32_t vk::physical_device::find_staging_memory(uint32_t restrict_mask) const {
+	return find_memory(memory_profile::cpu_to_gpu, restrict_mask);
+}
+
+uint32_t vk::physical_device::find_device_memory(uint32_t restrict_mask) const {
+	return find_memory(memory_profile::gpu_only, restrict_mask);
+}
+
+uint32_t vk::physical_device::find_readback_memory(uint32_t restrict_mask) const {
+	return find_memory(memory_profile::gpu_to_cpu, restrict_mask);
+}
+
 std::vector<vk::physical_device> const & vk::get_physical_devices() {
 	return physical_devices;
 }
@@ -19,7 +19,8 @@ typedef unsigned char byte;
 std::string strf(char const * fmt, ...) noexcept;
 char const * vk_result_to_str(VkResult);
 
-#define srcthrow(fmt, ...) throw vk::exception(strf("VULKANOMICS ERROR (%s, line %u): %s", __PRETTY_FUNCTION__, __LINE__, strf(fmt, ##__VA_ARGS__).c_str()))
+#define srcthrow_result(res, fmt, ...) throw vk::exception(strf("VULKANOMICS ERROR (%s, line %u): %s", __PRETTY_FUNCTION__, __LINE__, strf(fmt, ##__VA_ARGS__).c_str()), res)
+#define srcthrow(fmt, ...) srcthrow_result(VK_SUCCESS, fmt, ##__VA_ARGS__)
 
 #ifdef VULKANOMICS_DEBUG
 #define srcprintf_debug(fmt, ...) printf("%s\n", strf("VULKANOMICS DEBUG (%s, line %u): %s", __PRETTY_FUNCTION__, __LINE__, strf(fmt, ##__VA_ARGS__).c_str()).c_str())
@@ -37,4 +38,11 @@ char const * vk_result_to_str(VkResult);
 extern VkInstance vk_instance;
 
 static thread_local VkResult vk_res;
-#define VKR(call) vk_res = call; if (vk_res != VK_SUCCESS) srcthrow("\"%s\" unsuccessful: (%s)", #call, vk_result_to_str(vk_res));
+#define VKR(call) vk_res = call; if (vk_res != VK_SUCCESS) srcthrow_result(vk_res, "\"%s\" unsuccessful: (%s)", #call, vk_result_to_str(vk_res));
+
+static inline VkDeviceSize next_alignment(VkDeviceSize position, VkDeviceSize alignment) {
+	if (alignment == 0) return position;
+	VkDeviceSize r = position % alignment;
+	if (r == 0) return position;
+	return position + alignment - r;
+}
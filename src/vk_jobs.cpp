@@ -0,0 +1,100 @@
+#include "vulkanomics.hpp"
+#include "vk_internal.hpp"
+
+static constexpr size_t tasks_per_worker = 4; //leaves room for stealing to even out uneven tasks
+static thread_local vk::job_system const * worker_of = nullptr; //the job system whose worker this thread is
+
+vk::job_system::job_system(uint32_t workers) {
+	if (!workers) workers = 1;
+	for (uint32_t w = 0; w < workers; w++) queues.emplace_back(new worker_queue);
+	for (uint32_t w = 0; w < workers; w++) threads.emplace_back(&job_system::work, this, w);
+}
+
+vk::job_system::~job_system() {
+	{
+		std::lock_guard<std::mutex> lock(mut);
+		stopping = true;
+	}
+	cv_work.notify_all();
+	for (std::thread & t : threads) t.join();
+}
+
+void vk::job_system::run(size_t count, range_job const & fn, size_t grain) {
+	if (worker_of == this) srcthrow("job_system::run called from one of its own jobs, it would wait on the workers it blocks");
+	if (!count) return;
+	if (!grain) grain = std::max<size_t>(1, count / (queues.size() * tasks_per_worker));
+	batch b;
+	b.fn = &fn;
+	b.remaining = count;
+	
+	{ //counted before any is queued, so a worker taking one never brings pending below zero
+		std::lock_guard<std::mutex> lock(mut);
+		pending += (count + grain - 1) / grain;
+	}
+	size_t tasks = 0;
+	for (size_t begin = 0; begin < count; begin += grain, tasks++) {
+		worker_queue & q = *queues[tasks % queues.size()];
+		std::lock_guard<std::mutex> lock(q.mut);
+		q.tasks.push_back({&b, begin, std::min(begin + grain, count)});
+	}
+	cv_work.notify_all();
+	
+	std::unique_lock<std::mutex> lock(mut);
+	cv_done.wait(lock, [&b](){return b.remaining.load() == 0;});
+	if (b.error) std::rethrow_exception(b.error);
+}
+
+bool vk::job_system::take(uint32_t self, task & t) {
+	for (size_t i = 0; i < queues.size(); i++) {
+		worker_queue & q = *queues[(self + i) % queues.size()];
+		std::lock_guard<std::mutex> lock(q.mut);
+		if (q.front == q.tasks.size()) continue;
+		if (i) { //steal the oldest, likely the largest remaining share of its owner
+			t = q.tasks[q.front++];
+		} else {
+			t = q.tasks.back();
+			q.tasks.pop_back();
+		}
+		if (q.front == q.tasks.size()) {
+			q.tasks.clear();
+			q.front = 0;
+		}
+		pending--;
+		return true;
+	}
+	return false;
+}
+
+void vk::job_system::execute(task const & t, uint32_t worker) {
+	batch & b = *t.b;
+	try {
+		bool failed;
+		{
+			std::lock_guard<std::mutex> lock(b.error_mut);
+			failed = static_cast<bool>(b.error);
+		}
+		if (!failed) (*b.fn)(t.begin, t.end, worker);
+	} catch (...) {
+		std::lock_guard<std::mutex> lock(b.error_mut);
+		if (!b.error) b.error = std::current_exception();
+	}
+	size_t n = t.end - t.begin;
+	if (b.remaining.fetch_sub(n) == n) { //run() may return and take b with it from here on
+		std::lock_guard<std::mutex> lock(mut);
+		cv_done.notify_all();
+	}
+}
+
+void vk::job_system::work(uint32_t self) {
+	worker_of = this;
+	for (;;) {
+		task t;
+		if (take(self, t)) {
+			execute(t, self);
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(mut);
+		cv_work.wait(lock, [this](){return stopping || pending.load() > 0;});
+		if (stopping && !pending.load()) return;
+	}
+}
@@ -2,80 +2,332 @@
 #include "vk_internal.hpp"
 
 vk::memory::memory(device const & parent, uint32_t mem, VkDeviceSize size) : parent(parent), size_(size), mem_type_(mem) {
-	VkMemoryAllocateInfo memory_allocate_info = {
-		.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+	allocate();
+}
+
+vk::memory::memory(device const & parent, memory_profile profile, uint32_t type_bits, VkDeviceSize size) : parent(parent), size_(size) {
+	for (;;) {
+		mem_type_ = parent.parent.find_memory(profile, type_bits);
+		try {
+			allocate();
+			return;
+		} catch (vk::exception & e) {
+			type_bits &= ~(1u << mem_type_);
+			if (e.result != VK_ERROR_OUT_OF_DEVICE_MEMORY || !(type_bits & parent.parent.memory_type_mask(profile))) throw;
+		}
+	}
+}
+
+vk::memory::memory(device const & parent, uint32_t mem, vk::buffer & dedicated_to) : parent(parent), mem_type_(mem) {
+	VkMemoryRequirements req = dedicated_to.memory_requirements();
+	if (!(req.memoryTypeBits & (1u << mem))) srcthrow("memory type %u not permitted by memoryTypeBits 0x%X", mem, req.memoryTypeBits);
+	size_ = req.size;
+	#ifdef VK_KHR_dedicated_allocation
+	VkMemoryDedicatedAllocateInfoKHR dedicated_info = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO_KHR,
 		.pNext = nullptr,
-		.allocationSize = size_,
-		.memoryTypeIndex = mem,
+		.image = VK_NULL_HANDLE,
+		.buffer = dedicated_to.handle,
 	};
-	VKR(parent.vkAllocateMemory(parent, &memory_allocate_info, nullptr, &handle))
+	allocate(parent.has_extension("VK_KHR_dedicated_allocation") ? &dedicated_info : nullptr);
+	#else
+	allocate();
+	#endif
+	dedicated_to.bind_to_memory(0, *this);
 }
 
-static VkDeviceSize next_alignment(VkDeviceSize position, VkDeviceSize alignment) {
-	if (alignment == 0) return position;
-	VkDeviceSize r = position % alignment;
-	if (r == 0) return position;
-	return position + alignment - r;
+vk::memory::memory(device const & parent, uint32_t mem, vk::image & dedicated_to) : parent(parent), mem_type_(mem) {
+	VkMemoryRequirements req = dedicated_to.memory_requirements();
+	if (!(req.memoryTypeBits & (1u << mem))) srcthrow("memory type %u not permitted by memoryTypeBits 0x%X", mem, req.memoryTypeBits);
+	size_ = req.size;
+	#ifdef VK_KHR_dedicated_allocation
+	VkMemoryDedicatedAllocateInfoKHR dedicated_info = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO_KHR,
+		.pNext = nullptr,
+		.image = dedicated_to,
+		.buffer = VK_NULL_HANDLE,
+	};
+	allocate(parent.has_extension("VK_KHR_dedicated_allocation") ? &dedicated_info : nullptr);
+	#else
+	allocate();
+	#endif
+	dedicated_to.bind_to_memory(0, *this);
 }
 
-vk::memory::memory(device const & parent, uint32_t mem, std::vector<vk::memory_bound_structure *> const & buffers) : parent(parent), size_(0), mem_type_(mem) {
-	
-	std::vector<VkDeviceSize> offsets;
-	for (vk::memory_bound_structure * bufp : buffers) {
-		VkMemoryRequirements req = bufp->memory_requirements();
-		VkDeviceSize next_align = next_alignment(size_, req.alignment);
-		size_ = next_align + req.size;
-		offsets.emplace_back(next_align);
-	}
-	
+void vk::memory::allocate(void const * next) {
 	VkMemoryAllocateInfo memory_allocate_info = {
 		.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-		.pNext = nullptr,
+		.pNext = next,
 		.allocationSize = size_,
-		.memoryTypeIndex = mem,
+		.memoryTypeIndex = mem_type_,
 	};
 	VKR(parent.vkAllocateMemory(parent, &memory_allocate_info, nullptr, &handle))
+	parent.budget.allocated(mem_type_, size_);
+}
+
+/*
+	Optimally tiled images go first, then linear resources starting on a fresh bufferImageGranularity page,
+	so the two kinds never share a page. Within each group resources are ordered by descending alignment,
+	then size: sizes are usually multiples of their alignment, which leaves every offset already aligned for the next.
+*/
+static VkDeviceSize pack_offsets(vk::physical_device const & pdev, std::vector<vk::memory_bound_structure *> const & structures, std::vector<VkMemoryRequirements> const & reqs, std::vector<VkDeviceSize> & offsets) {
+	std::vector<size_t> order(structures.size());
+	for (size_t i = 0; i < order.size(); i++) order[i] = i;
+	std::sort(order.begin(), order.end(), [&](size_t a, size_t b){
+		if (structures[a]->linear() != structures[b]->linear()) return structures[b]->linear();
+		if (reqs[a].alignment != reqs[b].alignment) return reqs[a].alignment > reqs[b].alignment;
+		if (reqs[a].size != reqs[b].size) return reqs[a].size > reqs[b].size;
+		return a < b;
+	});
 	
+	VkDeviceSize size = 0;
+	offsets.resize(structures.size());
+	for (size_t oi = 0; oi < order.size(); oi++) {
+		size_t i = order[oi];
+		VkDeviceSize alignment = reqs[i].alignment;
+		if (oi && structures[i]->linear() && !structures[order[oi - 1]]->linear()) alignment = std::max(alignment, pdev.properties.limits.bufferImageGranularity);
+		offsets[i] = next_alignment(size, alignment);
+		size = offsets[i] + reqs[i].size;
+	}
+	return size;
+}
+
+vk::memory::memory(device const & parent, uint32_t mem, std::vector<vk::memory_bound_structure *> const & buffers) : parent(parent), size_(0), mem_type_(mem) {
+	
+	std::vector<VkMemoryRequirements> reqs;
+	VkDeviceSize used = 0;
 	for (size_t i = 0; i < buffers.size(); i++) {
-		buffers[i]->bind_to_memory(offsets[i], *this);
+		reqs.push_back(buffers[i]->memory_requirements());
+		if (!(reqs.back().memoryTypeBits & (1u << mem))) srcthrow("memory type %u not permitted for structure %zu (memoryTypeBits 0x%X)", mem, i, reqs.back().memoryTypeBits);
+		used += reqs.back().size;
 	}
+	std::vector<VkDeviceSize> offsets;
+	size_ = pack_offsets(parent.parent, buffers, reqs, offsets);
+	wasted_ = size_ - used;
+	allocate();
+	bind_all(buffers, reqs, offsets);
+}
+
+void vk::memory::bind_all(std::vector<vk::memory_bound_structure *> const & structures, std::vector<VkMemoryRequirements> const & reqs, std::vector<VkDeviceSize> const & offsets) {
+	#ifdef VK_KHR_bind_memory2
+	if (parent.vkBindBufferMemory2KHR) {
+		std::vector<VkBindBufferMemoryInfoKHR> buffer_binds;
+		std::vector<VkBindImageMemoryInfoKHR> image_binds;
+		std::vector<size_t> bulk_buffers, bulk_images;
+		for (size_t i = 0; i < structures.size(); i++) {
+			if (vk::buffer * b = dynamic_cast<vk::buffer *>(structures[i])) {
+				buffer_binds.push_back({VK_STRUCTURE_TYPE_BIND_BUFFER_MEMORY_INFO_KHR, nullptr, b->handle, handle, offsets[i]});
+				bulk_buffers.push_back(i);
+			} else if (vk::image * img = dynamic_cast<vk::image *>(structures[i])) {
+				image_binds.push_back({VK_STRUCTURE_TYPE_BIND_IMAGE_MEMORY_INFO_KHR, nullptr, *img, handle, offsets[i]});
+				bulk_images.push_back(i);
+			} else {
+				structures[i]->bind_to_memory(offsets[i], *this); //not known to have a bulk path
+			}
+		}
+		//each call binds all of its structures or, failing, leaves them to be treated as unbound
+		auto bound = [&](std::vector<size_t> const & bulk){
+			for (size_t i : bulk) {
+				structures[i]->bound_memory_ = this;
+				structures[i]->bound_offset_ = offsets[i];
+				structures[i]->bound_size_ = reqs[i].size;
+			}
+		};
+		if (buffer_binds.size()) {
+			VKR(parent.vkBindBufferMemory2KHR(parent, buffer_binds.size(), buffer_binds.data()))
+			bound(bulk_buffers);
+		}
+		if (image_binds.size()) {
+			VKR(parent.vkBindImageMemory2KHR(parent, image_binds.size(), image_binds.data()))
+			bound(bulk_images);
+		}
+		return;
+	}
+	#endif
+	for (size_t i = 0; i < structures.size(); i++) {
+		structures[i]->bind_to_memory(offsets[i], *this);
+	}
+}
+
+std::vector<std::unique_ptr<vk::memory>> vk::memory::pack(device const & parent, std::vector<vk::memory_bound_structure *> const & structures, uint32_t (physical_device::*select)(uint32_t) const) {
+	std::vector<std::unique_ptr<vk::memory>> mems;
+	std::vector<uint32_t> types;
+	std::vector<std::vector<vk::memory_bound_structure *>> groups;
+	for (vk::memory_bound_structure * s : structures) {
+		uint32_t type = (parent.parent.*select)(s->memory_requirements().memoryTypeBits);
+		if (s->dedicated_allocation() != vk::memory_bound_structure::dedication::none) {
+			if (vk::buffer * b = dynamic_cast<vk::buffer *>(s)) {
+				mems.emplace_back(new vk::memory {parent, type, *b});
+				continue;
+			}
+			if (vk::image * img = dynamic_cast<vk::image *>(s)) {
+				mems.emplace_back(new vk::memory {parent, type, *img});
+				continue;
+			}
+		}
+		size_t g = std::find(types.begin(), types.end(), type) - types.begin();
+		if (g == types.size()) {
+			types.push_back(type);
+			groups.emplace_back();
+		}
+		groups[g].push_back(s);
+	}
+	for (size_t g = 0; g < groups.size(); g++) mems.emplace_back(new vk::memory {parent, types[g], groups[g]});
+	return mems;
 }
 
 vk::memory::~memory() {
-	if (handle != VK_NULL_HANDLE) parent.vkFreeMemory(parent, handle, nullptr);
+	if (handle == VK_NULL_HANDLE) return;
+	if (parent.retirement) {
+		parent.retirement->retire_memory(handle, mem_type_, size_, mapped);
+		return;
+	}
+	if (mapped) parent.vkUnmapMemory(parent, handle);
+	parent.vkFreeMemory(parent, handle, nullptr);
+	parent.budget.freed(mem_type_, size_);
+}
+
+bool vk::memory::host_coherent() const {
+	return parent.parent.memory_properties.memoryTypes[mem_type_].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+}
+
+VkMappedMemoryRange vk::memory::atom_range(VkDeviceSize offset, VkDeviceSize size) const {
+	VkDeviceSize atom = std::max<VkDeviceSize>(parent.parent.properties.limits.nonCoherentAtomSize, 1);
+	VkDeviceSize end = size == VK_WHOLE_SIZE || offset + size > size_ ? size_ : offset + size;
+	offset -= offset % atom;
+	end = std::min(next_alignment(end, atom), size_);
+	VkMappedMemoryRange range = {
+		.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE,
+		.pNext = NULL,
+		.memory = handle,
+		.offset = offset,
+		.size = end - offset,
+	};
+	return range;
+}
+
+void * vk::memory::data() {
+	std::lock_guard<std::mutex> lock(mut);
+	if (!mapped) {
+		VKR(parent.vkMapMemory(parent, handle, 0, VK_WHOLE_SIZE, 0, &mapped))
+	}
+	return mapped;
+}
+
+void vk::memory::mark_dirty(VkDeviceSize offset, VkDeviceSize size) {
+	if (host_coherent() || !size || offset >= size_) return; //an empty range is invalid to flush
+	VkMappedMemoryRange range = atom_range(offset, size);
+	std::lock_guard<std::mutex> lock(mut);
+	//merge with every overlapping or touching range, the vector stays sorted by offset
+	std::vector<VkMappedMemoryRange>::iterator first = std::lower_bound(dirty.begin(), dirty.end(), range.offset, [](VkMappedMemoryRange const & r, VkDeviceSize o){return r.offset + r.size < o;});
+	std::vector<VkMappedMemoryRange>::iterator last = first;
+	VkDeviceSize end = range.offset + range.size;
+	for (; last != dirty.end() && last->offset <= end; last++) {
+		range.offset = std::min(range.offset, last->offset);
+		end = std::max(end, last->offset + last->size);
+	}
+	range.size = end - range.offset;
+	if (first == last) {
+		dirty.insert(first, range);
+	} else {
+		*first = range;
+		dirty.erase(first + 1, last);
+	}
+}
+
+void vk::memory::flush() {
+	std::lock_guard<std::mutex> lock(mut);
+	if (dirty.empty()) return;
+	VKR(parent.vkFlushMappedMemoryRanges(parent, dirty.size(), dirty.data()))
+	dirty.clear();
+}
+
+void vk::memory::flush(VkDeviceSize offset, VkDeviceSize size) {
+	if (host_coherent() || !size || offset >= size_) return;
+	VkMappedMemoryRange range = atom_range(offset, size);
+	std::lock_guard<std::mutex> lock(mut);
+	VKR(parent.vkFlushMappedMemoryRanges(parent, 1, &range))
+	//cut what was flushed out of the dirty ranges, the cuts fall on atom boundaries
+	VkDeviceSize end = range.offset + range.size;
+	std::vector<VkMappedMemoryRange>::iterator first = std::lower_bound(dirty.begin(), dirty.end(), range.offset, [](VkMappedMemoryRange const & r, VkDeviceSize o){return r.offset + r.size <= o;});
+	if (first == dirty.end()) return;
+	if (first->offset < range.offset && first->offset + first->size > end) { //strictly inside one range, split it
+		VkMappedMemoryRange after = *first;
+		after.offset = end;
+		after.size = first->offset + first->size - end;
+		first->size = range.offset - first->offset;
+		dirty.insert(first + 1, after);
+		return;
+	}
+	if (first->offset < range.offset) {
+		first->size = range.offset - first->offset;
+		first++;
+	}
+	std::vector<VkMappedMemoryRange>::iterator last = first;
+	while (last != dirty.end() && last->offset + last->size <= end) last++;
+	if (last != dirty.end() && last->offset < end) {
+		last->size = last->offset + last->size - end;
+		last->offset = end;
+	}
+	dirty.erase(first, last);
+}
+
+void vk::memory::invalidate(VkDeviceSize offset, VkDeviceSize size) {
+	if (host_coherent() || !size || offset >= size_) return;
+	VkMappedMemoryRange range = atom_range(offset, size);
+	VKR(parent.vkInvalidateMappedMemoryRanges(parent, 1, &range))
 }
 
 void * vk::memory::map(VkDeviceSize offset, VkDeviceSize size) {
-	if (mapped_size != 0) unmap();
-	mapped_offset = offset;
-	mapped_size = size;
-	void * region;
-	VKR(parent.vkMapMemory(parent, handle, offset, size, 0, &region))
+	if (offset >= size_) srcthrow("map offset %llu beyond allocation size %llu", static_cast<unsigned long long>(offset), static_cast<unsigned long long>(size_));
+	byte * region = reinterpret_cast<byte *>(data()) + offset;
+	mark_dirty(offset, size);
 	return region;
 }
 
 void vk::memory::unmap() {
-	if (!(parent.parent.memory_properties.memoryTypes[mem_type_].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) {
-		VkMappedMemoryRange flush_range = {
-			.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE,
-			.pNext = NULL,
-			.memory = handle,
-			.offset = mapped_offset,
-			.size = mapped_size,
-		};
-		VKR(parent.vkFlushMappedMemoryRanges(parent, 1, &flush_range))
-	}
-	parent.vkUnmapMemory(parent, handle);
-	mapped_offset = 0;
-	mapped_size = 0;
+	flush();
+}
+
+vk::memory_bound_structure::~memory_bound_structure() {
+	if (!allocation_) return;
+	if (allocation_.heap->parent.retirement) allocation_.heap->parent.retirement->retire_allocation(allocation_);
+	else allocation_.heap->free(allocation_);
+}
+
+std::function<void(vk::retirement_queue *)> vk::memory_bound_structure::move_to(command::buffer &, vk::memory &, VkDeviceSize) {
+	srcthrow("structure cannot be moved");
+}
+
+static inline VkDeviceSize clamp_size(VkDeviceSize offset, VkDeviceSize size, VkDeviceSize bound_size) {
+	if (offset > bound_size) srcthrow("offset %llu beyond bound size %llu", static_cast<unsigned long long>(offset), static_cast<unsigned long long>(bound_size));
+	return size == VK_WHOLE_SIZE || offset + size > bound_size ? bound_size - offset : size;
+}
+
+void * vk::memory_bound_structure::data() {
+	return reinterpret_cast<byte *>(bound_memory_->data()) + bound_offset_;
+}
+
+void vk::memory_bound_structure::mark_dirty(VkDeviceSize offset, VkDeviceSize size) {
+	bound_memory_->mark_dirty(bound_offset_ + offset, clamp_size(offset, size, bound_size_));
+}
+
+void vk::memory_bound_structure::flush(VkDeviceSize offset, VkDeviceSize size) {
+	bound_memory_->flush(bound_offset_ + offset, clamp_size(offset, size, bound_size_));
+}
+
+void vk::memory_bound_structure::invalidate(VkDeviceSize offset, VkDeviceSize size) {
+	bound_memory_->invalidate(bound_offset_ + offset, clamp_size(offset, size, bound_size_));
 }
 
 void * vk::memory_bound_structure::map() {
-	return bound_memory_->map(bound_offset_, memory_requirements().size);
+	void * region = data();
+	mark_dirty();
+	return region;
 }
 
 void vk::memory_bound_structure::unmap() {
-	bound_memory_->unmap();
+	bound_memory_->flush();
 }
 
 vk::buffer::buffer(device const & parent, VkDeviceSize size, VkBufferUsageFlags usage) : parent(parent), size_(size), usage_(usage) {
@@ -93,7 +345,9 @@ vk::buffer::buffer(device const & parent, VkDeviceSize size, VkBufferUsageFlags
 }
 
 vk::buffer::~buffer() {
-	if (handle != VK_NULL_HANDLE) parent.vkDestroyBuffer(parent, handle, nullptr);
+	if (handle == VK_NULL_HANDLE) return;
+	if (parent.retirement) parent.retirement->retire_buffer(handle);
+	else parent.vkDestroyBuffer(parent, handle, nullptr);
 }
 
 VkMemoryRequirements vk::buffer::memory_requirements() const {
@@ -102,10 +356,72 @@ VkMemoryRequirements vk::buffer::memory_requirements() const {
 	return req;
 }
 
+vk::memory_bound_structure::dedication vk::buffer::dedicated_allocation() const {
+	#ifdef VK_KHR_dedicated_allocation
+	if (!parent.vkGetBufferMemoryRequirements2KHR || !parent.has_extension("VK_KHR_dedicated_allocation")) return dedication::none;
+	VkMemoryDedicatedRequirementsKHR dedicated_req = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS_KHR,
+		.pNext = nullptr,
+		.prefersDedicatedAllocation = VK_FALSE,
+		.requiresDedicatedAllocation = VK_FALSE,
+	};
+	VkMemoryRequirements2KHR req = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2_KHR,
+		.pNext = &dedicated_req,
+		.memoryRequirements = {},
+	};
+	VkBufferMemoryRequirementsInfo2KHR info = {
+		.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_REQUIREMENTS_INFO_2_KHR,
+		.pNext = nullptr,
+		.buffer = handle,
+	};
+	parent.vkGetBufferMemoryRequirements2KHR(parent, &info, &req);
+	if (dedicated_req.requiresDedicatedAllocation) return dedication::required;
+	if (dedicated_req.prefersDedicatedAllocation) return dedication::preferred;
+	#endif
+	return dedication::none;
+}
+
 void vk::buffer::bind_to_memory(VkDeviceSize offset, vk::memory & mem) {
+	VKR(parent.vkBindBufferMemory(parent, handle, mem.handle, offset))
 	this->bound_offset_ = offset;
+	this->bound_size_ = memory_requirements().size;
 	this->bound_memory_ = &mem;
-	VKR(parent.vkBindBufferMemory(parent, handle, mem.handle, offset))
+}
+
+bool vk::buffer::movable() const {
+	return (usage_ & (VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT)) == (VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+}
+
+std::function<void(vk::retirement_queue *)> vk::buffer::move_to(command::buffer & cmd, vk::memory & mem, VkDeviceSize offset) {
+	VkBufferCreateInfo buffer_create = {
+		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+		.pNext = nullptr,
+		.flags = 0,
+		.size = size_,
+		.usage = usage_,
+		.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+		.queueFamilyIndexCount = 0,
+		.pQueueFamilyIndices = nullptr,
+	};
+	VkBuffer old = handle;
+	VKR(parent.vkCreateBuffer(parent, &buffer_create, nullptr, &handle))
+	try {
+		bind_to_memory(offset, mem);
+	} catch (vk::exception &) {
+		parent.vkDestroyBuffer(parent, handle, nullptr);
+		handle = old;
+		throw;
+	}
+	
+	VkBufferCopy region {0, 0, size_};
+	parent.vkCmdCopyBuffer(cmd.handle, old, handle, 1, &region);
+	
+	device const & dev = parent;
+	return [&dev, old](retirement_queue * retirement){
+		if (retirement) retirement->retire_buffer(old);
+		else dev.vkDestroyBuffer(dev, old, nullptr);
+	};
 }
 
 VkDescriptorBufferInfo vk::buffer::descript(VkDeviceSize offset, VkDeviceSize size ) {
@@ -135,9 +451,11 @@ vk::image::image(
 	VkSharingMode sharing_mode,
 	uint32_t const * queue_indicies,
 	uint32_t queue_indicies_count
-) : parent(parent), usage_(usage), format_(format), image_type_(type), layout_(layout) {
+) : parent(parent), usage_(usage), format_(format), image_type_(type), tiling_(tiling), layout_(layout) {
 	
-	VkImageCreateInfo create = {
+	if (queue_indicies_count) queue_families_.assign(queue_indicies, queue_indicies + queue_indicies_count);
+	
+	create_info_ = {
 		.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
 		.pNext = nullptr,
 		.flags = flags,
@@ -151,15 +469,17 @@ vk::image::image(
 		.usage = usage,
 		.sharingMode = sharing_mode,
 		.queueFamilyIndexCount = queue_indicies_count,
-		.pQueueFamilyIndices = queue_indicies,
+		.pQueueFamilyIndices = queue_families_.data(),
 		.initialLayout = layout
 	};
 	
-	VKR(parent.vkCreateImage(parent, &create, nullptr, &handle))
+	VKR(parent.vkCreateImage(parent, &create_info_, nullptr, &handle))
 }
 
 vk::image::~image() {
-	if (handle != VK_NULL_HANDLE) parent.vkDestroyImage(parent, handle, nullptr);
+	if (handle == VK_NULL_HANDLE) return;
+	if (parent.retirement) parent.retirement->retire_image(handle);
+	else parent.vkDestroyImage(parent, handle, nullptr);
 }
 
 VkMemoryRequirements vk::image::memory_requirements() const {
@@ -168,10 +488,133 @@ VkMemoryRequirements vk::image::memory_requirements() const {
 	return req;
 }
 
+vk::memory_bound_structure::dedication vk::image::dedicated_allocation() const {
+	#ifdef VK_KHR_dedicated_allocation
+	if (!parent.vkGetImageMemoryRequirements2KHR || !parent.has_extension("VK_KHR_dedicated_allocation")) return dedication::none;
+	VkMemoryDedicatedRequirementsKHR dedicated_req = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS_KHR,
+		.pNext = nullptr,
+		.prefersDedicatedAllocation = VK_FALSE,
+		.requiresDedicatedAllocation = VK_FALSE,
+	};
+	VkMemoryRequirements2KHR req = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2_KHR,
+		.pNext = &dedicated_req,
+		.memoryRequirements = {},
+	};
+	VkImageMemoryRequirementsInfo2KHR info = {
+		.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2_KHR,
+		.pNext = nullptr,
+		.image = handle,
+	};
+	parent.vkGetImageMemoryRequirements2KHR(parent, &info, &req);
+	if (dedicated_req.requiresDedicatedAllocation) return dedication::required;
+	if (dedicated_req.prefersDedicatedAllocation) return dedication::preferred;
+	#endif
+	return dedication::none;
+}
+
 void vk::image::bind_to_memory(VkDeviceSize offset, vk::memory & mem) {
+	VKR(parent.vkBindImageMemory(parent, handle, mem.handle, offset))
 	this->bound_offset_ = offset;
+	this->bound_size_ = memory_requirements().size;
 	this->bound_memory_ = &mem;
-	VKR(parent.vkBindImageMemory(parent, handle, mem.handle, offset))
+}
+
+static VkImageAspectFlags format_aspects(VkFormat format) {
+	switch (format) {
+		case VK_FORMAT_D16_UNORM:
+		case VK_FORMAT_X8_D24_UNORM_PACK32:
+		case VK_FORMAT_D32_SFLOAT:
+			return VK_IMAGE_ASPECT_DEPTH_BIT;
+		case VK_FORMAT_S8_UINT:
+			return VK_IMAGE_ASPECT_STENCIL_BIT;
+		case VK_FORMAT_D16_UNORM_S8_UINT:
+		case VK_FORMAT_D24_UNORM_S8_UINT:
+		case VK_FORMAT_D32_SFLOAT_S8_UINT:
+			return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+		default:
+			return VK_IMAGE_ASPECT_COLOR_BIT;
+	}
+}
+
+VkImageAspectFlags vk::image::aspects() const {
+	return format_aspects(format_);
+}
+
+bool vk::image::movable() const {
+	if (!layout_tracked_) return false; //transitioned where the image never learnt of it, the copy would use a stale layout
+	if (layout_ == VK_IMAGE_LAYOUT_PREINITIALIZED) return false; //a new image cannot be recreated with these contents
+	return (usage_ & (VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT)) == (VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+}
+
+std::function<void(vk::retirement_queue *)> vk::image::move_to(command::buffer & cmd, vk::memory & mem, VkDeviceSize offset) {
+	VkImageCreateInfo create = create_info_;
+	create.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	VkImage old = handle;
+	VKR(parent.vkCreateImage(parent, &create, nullptr, &handle))
+	try {
+		bind_to_memory(offset, mem);
+	} catch (vk::exception &) {
+		parent.vkDestroyImage(parent, handle, nullptr);
+		handle = old;
+		throw;
+	}
+	
+	device const & dev = parent;
+	std::function<void(retirement_queue *)> release = [&dev, old](retirement_queue * retirement){
+		if (retirement) retirement->retire_image(old);
+		else dev.vkDestroyImage(dev, old, nullptr);
+	};
+	if (layout_ == VK_IMAGE_LAYOUT_UNDEFINED) return release; //known to have no contents to keep
+	
+	VkImageSubresourceRange range = {
+		.aspectMask = format_aspects(format_),
+		.baseMipLevel = 0,
+		.levelCount = create.mipLevels,
+		.baseArrayLayer = 0,
+		.layerCount = create.arrayLayers,
+	};
+	VkImageMemoryBarrier before[2] = {{
+		.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+		.pNext = nullptr,
+		.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
+		.oldLayout = layout_,
+		.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.image = old,
+		.subresourceRange = range,
+	}, {
+		.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+		.pNext = nullptr,
+		.srcAccessMask = 0,
+		.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+		.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+		.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.image = handle,
+		.subresourceRange = range,
+	}};
+	parent.vkCmdPipelineBarrier(cmd.handle, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 2, before);
+	
+	std::vector<VkImageCopy> regions;
+	for (uint32_t m = 0; m < create.mipLevels; m++) {
+		VkImageSubresourceLayers layers = {range.aspectMask, m, 0, create.arrayLayers};
+		VkExtent3D extent = {std::max(create.extent.width >> m, 1u), std::max(create.extent.height >> m, 1u), std::max(create.extent.depth >> m, 1u)};
+		regions.push_back({layers, {0, 0, 0}, layers, {0, 0, 0}, extent});
+	}
+	parent.vkCmdCopyImage(cmd.handle, old, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, handle, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, regions.size(), regions.data());
+	
+	VkImageMemoryBarrier after = before[1];
+	after.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	after.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+	after.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	after.newLayout = layout_;
+	parent.vkCmdPipelineBarrier(cmd.handle, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 1, &after);
+	return release;
 }
 
 vk::image::view::view(image const & parent, VkImageViewType view_type, VkImageAspectFlags aspect_flags, uint32_t base_mip, uint32_t base_layer, VkComponentMapping cmap) : parent(parent) {
@@ -195,5 +638,7 @@ vk::image::view::view(image const & parent, VkImageViewType view_type, VkImageAs
 }
 
 vk::image::view::~view() {
-	if (handle != VK_NULL_HANDLE) parent.parent.vkDestroyImageView(parent.parent, handle, nullptr);
+	if (handle == VK_NULL_HANDLE) return;
+	if (parent.parent.retirement) parent.parent.retirement->retire_image_view(handle);
+	else parent.parent.vkDestroyImageView(parent.parent, handle, nullptr);
 }
@@ -99,8 +99,18 @@ void vk::fence::reset() {
 	VKR(parent.vkResetFences(parent, 1, &handle))
 }
 
-void vk::fence::wait(uint64_t timeout) {
-	parent.vkWaitForFences(parent, 1, &handle, VK_FALSE, timeout);
+bool vk::fence::wait(uint64_t timeout) const {
+	VkResult res = parent.vkWaitForFences(parent, 1, &handle, VK_FALSE, timeout);
+	if (res == VK_TIMEOUT) return false;
+	VKR(res)
+	return true;
+}
+
+bool vk::fence::signaled() const {
+	VkResult res = parent.vkGetFenceStatus(parent, handle);
+	if (res == VK_NOT_READY) return false;
+	VKR(res)
+	return true;
 }
 
 vk::semaphore::semaphore(device const & parent) : parent(parent) {
@@ -132,11 +142,10 @@ vk::shader::~shader() {
 }
 
 void vk::queue_accessor_direct::submit(VkSubmitInfo * infos, uint32_t infos_count, VkFence fence) {
-	parent.vkQueueSubmit(queue.handle, infos_count, infos, fence);
+	VKR(parent.vkQueueSubmit(queue.handle, infos_count, infos, fence))
 }
 
 void vk::queue_accessor_mutexed::submit(VkSubmitInfo * infos, uint32_t infos_count, VkFence fence) {
-	mut.lock();
-	parent.vkQueueSubmit(queue.handle, infos_count, infos, fence);
-	mut.unlock();
+	std::lock_guard<std::mutex> lock(mut);
+	VKR(parent.vkQueueSubmit(queue.handle, infos_count, infos, fence))
 }
@@ -5,15 +5,17 @@ vk::pipeline::layout::layout(device const & parent, VkPipelineLayoutCreateInfo c
 	VKR(parent.vkCreatePipelineLayout(parent, create, nullptr, &handle))
 }
 
-vk::pipeline::layout::layout(device const & parent, std::vector<VkDescriptorSetLayout> descriptor_sets, std::vector<VkPushConstantRange> push_constants) : parent(parent) {
+vk::pipeline::layout::layout(device const & parent, std::vector<VkDescriptorSetLayout> const & descriptor_sets, std::vector<VkPushConstantRange> const & push_constants) : layout(parent, descriptor_sets.data(), descriptor_sets.size(), push_constants.data(), push_constants.size()) {}
+
+vk::pipeline::layout::layout(device const & parent, VkDescriptorSetLayout const * descriptor_sets, uint32_t descriptor_sets_count, VkPushConstantRange const * push_constants, uint32_t push_constants_count) : parent(parent) {
 	VkPipelineLayoutCreateInfo pipeline_layout_create = {
 		.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
 		.pNext = nullptr,
 		.flags = 0,
-		.setLayoutCount = static_cast<uint32_t>(descriptor_sets.size()),
-		.pSetLayouts = descriptor_sets.data(),
-		.pushConstantRangeCount = static_cast<uint32_t>(push_constants.size()),
-		.pPushConstantRanges = push_constants.data(),
+		.setLayoutCount = descriptor_sets_count,
+		.pSetLayouts = descriptor_sets,
+		.pushConstantRangeCount = push_constants_count,
+		.pPushConstantRanges = push_constants,
 	};
 	VKR(parent.vkCreatePipelineLayout(parent, &pipeline_layout_create, nullptr, &handle))
 }
@@ -25,7 +27,9 @@ vk::pipeline::layout::~layout() {
 }
 
 vk::pipeline::~pipeline() {
-	if (handle != VK_NULL_HANDLE) parent.vkDestroyPipeline(parent, handle, nullptr);
+	if (handle == VK_NULL_HANDLE) return;
+	if (parent.retirement) parent.retirement->retire_pipeline(handle);
+	else parent.vkDestroyPipeline(parent, handle, nullptr);
 }
 
 vk::graphics_pipeline::graphics_pipeline(device const & parent, VkGraphicsPipelineCreateInfo const * create) : pipeline(parent) {
@@ -0,0 +1,82 @@
+#include "vulkanomics.hpp"
+#include "vk_internal.hpp"
+
+vk::program::program(device const & parent, queue_accessor & queue, VkDeviceSize param_size, uint32_t slots, recorder const & record) :
+	parent(parent),
+	queue(queue),
+	param_size_(param_size),
+	param_stride_(0),
+	pool(parent, 0, queue.queue_family),
+	slots_(slots)
+{
+	if (!slots) srcthrow("program requires at least one slot");
+	
+	VkDescriptorBufferInfo no_params = {VK_NULL_HANDLE, 0, 0};
+	if (!param_size_) {
+		recordings.emplace_back(new command::buffer {pool});
+		recordings[0]->begin(VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT);
+		record(*recordings[0], no_params, 0);
+		recordings[0]->end();
+		for (slot & s : slots_) s.cmd = recordings[0].get();
+	} else {
+		VkPhysicalDeviceLimits const & limits = parent.parent.properties.limits;
+		VkDeviceSize alignment = std::max({limits.minUniformBufferOffsetAlignment, limits.minStorageBufferOffsetAlignment, limits.nonCoherentAtomSize});
+		param_stride_ = next_alignment(param_size_, alignment);
+		params.reset(new vk::buffer {parent, param_stride_ * slots, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT});
+		params_mem.reset(new vk::memory {parent, parent.parent.find_staging_memory(params->memory_requirements().memoryTypeBits), std::vector<vk::memory_bound_structure *> {params.get()}});
+		for (uint32_t i = 0; i < slots; i++) {
+			recordings.emplace_back(new command::buffer {pool});
+			recordings[i]->begin(0); //resubmitted, but only once the previous submit of the slot has retired
+			record(*recordings[i], {params->handle, param_stride_ * i, param_size_}, i);
+			recordings[i]->end();
+			slots_[i].cmd = recordings[i].get();
+		}
+	}
+	for (slot & s : slots_) s.done.reset(new vk::fence {parent});
+}
+
+vk::program::~program() {
+	wait();
+}
+
+void vk::program::submit(void const * values, VkSemaphore const * wait, VkPipelineStageFlags const * wait_stages, uint32_t wait_count, VkSemaphore const * signal, uint32_t signal_count) {
+	std::lock_guard<std::mutex> lock(mut);
+	uint32_t index = next;
+	next = (next + 1) % slots_.size();
+	slot & s = slots_[index];
+	if (s.pending) {
+		s.done->wait();
+		s.done->reset();
+		s.pending = false;
+	}
+	
+	if (params) {
+		if (!values) srcthrow("program takes %llu bytes of parameters", static_cast<unsigned long long>(param_size_));
+		memcpy(reinterpret_cast<uint8_t *>(params->data()) + param_stride_ * index, values, param_size_);
+		params->flush(param_stride_ * index, param_size_);
+	}
+	
+	VkSubmitInfo submit_info = {
+		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+		.pNext = nullptr,
+		.waitSemaphoreCount = wait_count,
+		.pWaitSemaphores = wait,
+		.pWaitDstStageMask = wait_stages,
+		.commandBufferCount = 1,
+		.pCommandBuffers = &s.cmd->handle,
+		.signalSemaphoreCount = signal_count,
+		.pSignalSemaphores = signal,
+	};
+	queue.submit(&submit_info, 1, *s.done);
+	s.pending = true;
+}
+
+void vk::program::wait() {
+	std::lock_guard<std::mutex> lock(mut);
+	for (slot & s : slots_) {
+		if (!s.pending) continue;
+		s.done->wait();
+		s.done->reset();
+		s.pending = false;
+	}
+}
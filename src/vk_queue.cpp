@@ -0,0 +1,138 @@
+#include "vulkanomics.hpp"
+#include "vk_internal.hpp"
+
+vk::queue_accessor_coalescing::queue_accessor_coalescing(vk::device & parent, uint32_t index, std::chrono::microseconds max_latency, uint32_t max_infos) :
+	queue_accessor(parent, index),
+	max_latency(max_latency),
+	max_infos(max_infos),
+	head(&stub),
+	tail(&stub)
+{
+	if (!max_infos) srcthrow("coalescing queue accessor requires at least one submit info per batch");
+	infos_scratch.reserve(max_infos);
+	thread = std::thread {&queue_accessor_coalescing::submitter, this};
+}
+
+vk::queue_accessor_coalescing::~queue_accessor_coalescing() {
+	{
+		std::lock_guard<std::mutex> lock(mut_idle);
+		stopping = true;
+	}
+	cv_idle.notify_one();
+	thread.join();
+}
+
+void vk::queue_accessor_coalescing::submit(VkSubmitInfo * infos, uint32_t infos_count, VkFence fence) {
+	request r;
+	r.infos = infos;
+	r.infos_count = infos_count;
+	r.fence = fence;
+	push(&r);
+	if (idle.exchange(false)) {
+		{ std::lock_guard<std::mutex> lock(mut_idle); }
+		cv_idle.notify_one();
+	}
+	{
+		std::unique_lock<std::mutex> lock(mut_done);
+		cv_done.wait(lock, [&r](){return r.done.load(std::memory_order_acquire);});
+	}
+	if (r.result != VK_SUCCESS) srcthrow_result(r.result, "\"vkQueueSubmit\" unsuccessful: (%s)", vk_result_to_str(r.result));
+}
+
+void vk::queue_accessor_coalescing::push(request * r) {
+	r->next.store(nullptr, std::memory_order_relaxed);
+	request * prev = head.exchange(r); //seq_cst, pairs with the idle check of the submitter
+	prev->next.store(r, std::memory_order_release);
+}
+
+//nullptr when empty, or when the newest request is still being linked by its producer
+vk::queue_accessor_coalescing::request * vk::queue_accessor_coalescing::pop() {
+	request * t = tail;
+	request * next = t->next.load(std::memory_order_acquire);
+	if (t == &stub) {
+		if (!next) return nullptr;
+		tail = t = next;
+		next = t->next.load(std::memory_order_acquire);
+	}
+	if (next) {
+		tail = next;
+		return t;
+	}
+	if (t != head.load(std::memory_order_acquire)) return nullptr;
+	push(&stub);
+	next = t->next.load(std::memory_order_acquire);
+	if (next) {
+		tail = next;
+		return t;
+	}
+	return nullptr;
+}
+
+bool vk::queue_accessor_coalescing::empty() const {
+	return tail == &stub && head.load() == &stub;
+}
+
+vk::queue_accessor_coalescing::request * vk::queue_accessor_coalescing::pop_wait() {
+	for (;;) {
+		request * r = pop();
+		if (r) return r;
+		if (!empty()) { //a producer is between linking steps
+			std::this_thread::yield();
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(mut_idle);
+		idle.store(true);
+		if (!empty()) {
+			idle.store(false);
+			continue;
+		}
+		if (stopping) return nullptr;
+		cv_idle.wait(lock, [this](){return !idle.load() || stopping;});
+		idle.store(false);
+	}
+}
+
+void vk::queue_accessor_coalescing::submitter() {
+	std::vector<request *> batch;
+	request * carry = nullptr;
+	for (;;) {
+		request * first = carry ? carry : pop_wait();
+		carry = nullptr;
+		if (!first) return;
+		
+		batch.push_back(first);
+		VkFence fence = first->fence;
+		uint32_t infos_count = first->infos_count;
+		std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + max_latency;
+		while (infos_count < max_infos) {
+			request * r = pop();
+			if (!r) {
+				if (stopping || std::chrono::steady_clock::now() >= deadline) break;
+				std::this_thread::yield();
+				continue;
+			}
+			if ((r->fence && fence) || infos_count + r->infos_count > max_infos) {
+				carry = r;
+				break;
+			}
+			if (r->fence) fence = r->fence;
+			infos_count += r->infos_count;
+			batch.push_back(r);
+		}
+		flush(batch, fence);
+	}
+}
+
+//the infos of a batch keep their submission order, so merging them changes nothing but the number of calls
+void vk::queue_accessor_coalescing::flush(std::vector<request *> & batch, VkFence fence) {
+	infos_scratch.clear();
+	for (request * r : batch) infos_scratch.insert(infos_scratch.end(), r->infos, r->infos + r->infos_count);
+	VkResult res = parent.vkQueueSubmit(queue.handle, infos_scratch.size(), infos_scratch.data(), fence);
+	for (request * r : batch) {
+		r->result = res;
+		r->done.store(true, std::memory_order_release);
+	}
+	batch.clear();
+	{ std::lock_guard<std::mutex> lock(mut_done); } //a producer between its check and its wait would miss the notification
+	cv_done.notify_all();
+}
@@ -0,0 +1,201 @@
+#include "vulkanomics.hpp"
+#include "vk_internal.hpp"
+
+vk::readback::readback(device const & parent, queue_accessor & queue, VkDeviceSize size, uint32_t max_batches) :
+	parent(parent),
+	queue(queue),
+	size_(size),
+	buf(parent, size, VK_BUFFER_USAGE_TRANSFER_DST_BIT),
+	mem(parent, parent.parent.find_readback_memory(buf.memory_requirements().memoryTypeBits), std::vector<vk::memory_bound_structure *> {&buf}),
+	pool(parent, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT, queue.queue_family),
+	base(reinterpret_cast<uint8_t const *>(buf.data())),
+	batches(max_batches)
+{
+	if (!max_batches) srcthrow("readback requires at least one batch");
+	for (batch & b : batches) {
+		b.cmd.reset(new command::buffer {pool});
+		b.done.reset(new vk::fence {parent});
+	}
+	completion = std::thread {&readback::complete, this};
+}
+
+vk::readback::~readback() {
+	std::vector<request> unsubmitted;
+	std::exception_ptr error;
+	{
+		std::unique_lock<std::mutex> lock(mut);
+		try {
+			submit(lock, nullptr, nullptr, 0);
+		} catch (...) { //nothing may escape a destructor, the requests it could not submit are told instead
+			error = std::current_exception();
+			unsubmitted.swap(requests);
+		}
+		stopping = true;
+	}
+	cv_submitted.notify_all();
+	completion.join();
+	for (request & r : unsubmitted) {
+		try {
+			r.cb(nullptr, r.size, error);
+		} catch (...) {}
+	}
+}
+
+void vk::readback::complete() {
+	std::unique_lock<std::mutex> lock(mut);
+	for (;;) {
+		cv_submitted.wait(lock, [this](){return in_flight || stopping;});
+		if (!in_flight) return;
+		batch & b = batches[oldest];
+		lock.unlock();
+
+		//failures go to the requests, nothing may escape the thread
+		std::exception_ptr error, thrown;
+		try {
+			b.done->wait();
+		} catch (...) {
+			error = std::current_exception();
+		}
+		for (request & r : b.requests) {
+			std::exception_ptr request_error = error;
+			if (!request_error) {
+				try {
+					buf.invalidate(r.offset, r.size);
+				} catch (...) {
+					request_error = std::current_exception();
+				}
+			}
+			try {
+				r.cb(request_error ? nullptr : base + r.offset, r.size, request_error);
+			} catch (...) {
+				if (!thrown) thrown = std::current_exception();
+			}
+		}
+		b.requests.clear();
+		try {
+			b.done->reset();
+		} catch (...) {
+			if (!thrown) thrown = std::current_exception();
+		}
+
+		lock.lock();
+		if (thrown && !callback_error) callback_error = thrown;
+		tail = b.end;
+		oldest = (oldest + 1) % batches.size();
+		in_flight--;
+		cv_retired.notify_all();
+	}
+}
+
+//with mut held
+void vk::readback::rethrow_callback_error() {
+	if (!callback_error) return;
+	std::exception_ptr e;
+	e.swap(callback_error);
+	std::rethrow_exception(e);
+}
+
+VkDeviceSize vk::readback::reserve(std::unique_lock<std::mutex> & lock, VkDeviceSize size, VkDeviceSize alignment) {
+	if (size > size_) srcthrow("readback of %llu bytes exceeds the ring size of %llu bytes", static_cast<unsigned long long>(size), static_cast<unsigned long long>(size_));
+	for (;;) {
+		if (head == tail && !in_flight) head = tail = next_alignment(head, size_); //not while a batch can still set tail to its end
+		VkDeviceSize phys = head % size_;
+		VkDeviceSize offset = next_alignment(phys, alignment);
+		uint64_t begin = head + offset - phys;
+		if (offset + size > size_) {
+			begin = head + size_ - phys;
+			offset = 0;
+		}
+		if (begin + size - tail <= size_) {
+			head = begin + size;
+			return offset;
+		}
+		if (!in_flight) submit(lock, nullptr, nullptr, 0);
+		cv_retired.wait(lock);
+	}
+}
+
+void vk::readback::read(vk::buffer const & src, VkDeviceSize offset, VkDeviceSize size, callback cb) {
+	std::unique_lock<std::mutex> lock(mut);
+	rethrow_callback_error();
+	VkDeviceSize at = reserve(lock, size, std::max<VkDeviceSize>(16, parent.parent.properties.limits.nonCoherentAtomSize));
+	buffer_copy c;
+	c.src = &src;
+	c.region.srcOffset = offset;
+	c.region.dstOffset = at;
+	c.region.size = size;
+	buffer_copies.push_back(c);
+	requests.push_back({at, size, std::move(cb)});
+}
+
+void vk::readback::read(vk::image const & src, VkImageLayout src_layout, VkBufferImageCopy region, VkDeviceSize size, callback cb) {
+	std::unique_lock<std::mutex> lock(mut);
+	rethrow_callback_error();
+	VkDeviceSize alignment = std::max<VkDeviceSize>(parent.parent.properties.limits.nonCoherentAtomSize, parent.parent.properties.limits.optimalBufferCopyOffsetAlignment);
+	region.bufferOffset = reserve(lock, size, std::max<VkDeviceSize>(16, alignment));
+	image_copies.push_back({&src, src_layout, region});
+	requests.push_back({region.bufferOffset, size, std::move(cb)});
+}
+
+std::future<std::vector<uint8_t>> vk::readback::read(vk::buffer const & src, VkDeviceSize offset, VkDeviceSize size) {
+	std::shared_ptr<std::promise<std::vector<uint8_t>>> result = std::make_shared<std::promise<std::vector<uint8_t>>>();
+	std::future<std::vector<uint8_t>> f = result->get_future();
+	read(src, offset, size, [result](void const * data, VkDeviceSize size, std::exception_ptr error){
+		if (error) {
+			result->set_exception(error);
+			return;
+		}
+		uint8_t const * bytes = reinterpret_cast<uint8_t const *>(data);
+		result->set_value(std::vector<uint8_t>(bytes, bytes + size));
+	});
+	return f;
+}
+
+void vk::readback::submit(VkSemaphore const * wait, VkPipelineStageFlags const * wait_stages, uint32_t wait_count) {
+	std::unique_lock<std::mutex> lock(mut);
+	rethrow_callback_error();
+	submit(lock, wait, wait_stages, wait_count);
+}
+
+void vk::readback::submit(std::unique_lock<std::mutex> & lock, VkSemaphore const * wait, VkPipelineStageFlags const * wait_stages, uint32_t wait_count) {
+	if (requests.empty()) return;
+	while (in_flight == batches.size()) cv_retired.wait(lock);
+	batch & b = batches[(oldest + in_flight) % batches.size()];
+
+	b.cmd->begin();
+
+	std::sort(buffer_copies.begin(), buffer_copies.end(), [](buffer_copy const & a, buffer_copy const & b){return a.src < b.src;}); //the regions never overlap, any order will do
+	for (size_t i = 0; i < buffer_copies.size();) {
+		vk::buffer const * src = buffer_copies[i].src;
+		regions_scratch.clear();
+		for (; i < buffer_copies.size() && buffer_copies[i].src == src; i++) regions_scratch.push_back(buffer_copies[i].region);
+		b.cmd->copy_buffer(*src, buf, regions_scratch.data(), regions_scratch.size());
+	}
+	for (image_copy const & c : image_copies) {
+		b.cmd->copy_image_to_buffer(*c.src, c.layout, buf, &c.region, 1);
+	}
+	VkMemoryBarrier host_read = {VK_STRUCTURE_TYPE_MEMORY_BARRIER, nullptr, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_HOST_READ_BIT};
+	b.cmd->barrier(VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, &host_read, 1, nullptr, 0, nullptr, 0);
+
+	b.cmd->end();
+
+	VkSubmitInfo submit_info = {
+		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+		.pNext = nullptr,
+		.waitSemaphoreCount = wait_count,
+		.pWaitSemaphores = wait,
+		.pWaitDstStageMask = wait_stages,
+		.commandBufferCount = 1,
+		.pCommandBuffers = &b.cmd->handle,
+		.signalSemaphoreCount = 0,
+		.pSignalSemaphores = nullptr,
+	};
+	queue.submit(&submit_info, 1, *b.done);
+
+	b.requests.swap(requests);
+	b.end = head;
+	in_flight++;
+	buffer_copies.clear();
+	image_copies.clear();
+	cv_submitted.notify_one();
+}
@@ -0,0 +1,233 @@
+#include "vulkanomics.hpp"
+#include "vk_internal.hpp"
+
+vk::retirement_queue::retirement_queue(device const & parent) : parent(parent) {
+	if (parent.retirement) srcthrow("device already has a retirement queue");
+	const_cast<device &>(parent).retirement = this;
+}
+
+vk::retirement_queue::~retirement_queue() {
+	const_cast<device &>(parent).retirement = nullptr;
+	garbage all;
+	for (closed_epoch & e : closed) {
+		if (e.fence) parent.vkWaitForFences(parent, 1, &e.fence, VK_TRUE, UINT64_MAX);
+		else if (e.future.timeline) e.future.wait();
+		all.append(std::move(e.objects));
+	}
+	closed.clear();
+	all.append(std::move(open));
+	for (std::pair<VkCommandPool const, std::vector<VkCommandBuffer>> & p : passed_command_buffers) for (VkCommandBuffer h : p.second) all.command_buffers.emplace_back(p.first, h);
+	for (std::pair<VkDescriptorPool const, std::vector<VkDescriptorSet>> & p : passed_sets) for (VkDescriptorSet h : p.second) all.sets.emplace_back(p.first, h);
+	free(all);
+}
+
+size_t vk::retirement_queue::garbage::count() const {
+	return buffers.size() + images.size() + views.size() + memories.size() + allocations.size() + sets.size() + descriptor_pools.size() + command_buffers.size() + command_pools.size() + pipelines.size();
+}
+
+template <typename T> static inline void append_all(std::vector<T> & dst, std::vector<T> & src) {
+	if (dst.empty()) dst.swap(src);
+	else dst.insert(dst.end(), src.begin(), src.end());
+	src.clear();
+}
+
+void vk::retirement_queue::garbage::append(garbage && other) {
+	append_all(buffers, other.buffers);
+	append_all(images, other.images);
+	append_all(views, other.views);
+	append_all(memories, other.memories);
+	append_all(allocations, other.allocations);
+	append_all(sets, other.sets);
+	append_all(descriptor_pools, other.descriptor_pools);
+	append_all(command_buffers, other.command_buffers);
+	append_all(command_pools, other.command_pools);
+	append_all(pipelines, other.pipelines);
+}
+
+uint64_t vk::retirement_queue::epoch() const {
+	std::lock_guard<std::mutex> lock(mut);
+	return open_epoch;
+}
+
+uint64_t vk::retirement_queue::close() {
+	return close(gpu_future {});
+}
+
+uint64_t vk::retirement_queue::close(vk::fence const & f) {
+	std::lock_guard<std::mutex> lock(mut);
+	closed.push_back({open_epoch, f, {}, std::move(open)});
+	open = {};
+	return open_epoch++;
+}
+
+uint64_t vk::retirement_queue::close(gpu_future future) {
+	std::lock_guard<std::mutex> lock(mut);
+	closed.push_back({open_epoch, VK_NULL_HANDLE, future, std::move(open)});
+	open = {};
+	return open_epoch++;
+}
+
+void vk::retirement_queue::passed(uint64_t epoch) {
+	std::lock_guard<std::mutex> lock(mut);
+	passed_epoch = std::max(passed_epoch, epoch);
+}
+
+//with mut held
+bool vk::retirement_queue::has_passed(closed_epoch const & e) const {
+	if (e.number <= passed_epoch) return true;
+	if (e.fence) {
+		VkResult res = parent.vkGetFenceStatus(parent, e.fence);
+		if (res == VK_NOT_READY) return false;
+		VKR(res)
+		return true;
+	}
+	return e.future.timeline && e.future.ready();
+}
+
+size_t vk::retirement_queue::collect() {
+	garbage passed_objects;
+	{
+		std::lock_guard<std::mutex> lock(mut);
+		while (!closed.empty() && has_passed(closed.front())) { //in order, a later epoch cannot pass before an earlier one
+			passed_objects.append(std::move(closed.front().objects));
+			closed.pop_front();
+		}
+		//children wait for the thread of their pool, unless the pool goes with them
+		for (std::pair<VkCommandPool, VkCommandBuffer> const & h : passed_objects.command_buffers) passed_command_buffers[h.first].push_back(h.second);
+		for (std::pair<VkDescriptorPool, VkDescriptorSet> const & h : passed_objects.sets) passed_sets[h.first].push_back(h.second);
+		passed_objects.command_buffers.clear();
+		passed_objects.sets.clear();
+		for (VkCommandPool h : passed_objects.command_pools) passed_command_buffers.erase(h);
+		for (VkDescriptorPool h : passed_objects.descriptor_pools) passed_sets.erase(h);
+	}
+	size_t count = passed_objects.count();
+	free(passed_objects);
+	return count;
+}
+
+size_t vk::retirement_queue::collect_command_pool(VkCommandPool pool) {
+	std::vector<VkCommandBuffer> handles;
+	{
+		std::lock_guard<std::mutex> lock(mut);
+		std::map<VkCommandPool, std::vector<VkCommandBuffer>>::iterator iter = passed_command_buffers.find(pool);
+		if (iter == passed_command_buffers.end()) return 0;
+		handles.swap(iter->second);
+		passed_command_buffers.erase(iter);
+	}
+	parent.vkFreeCommandBuffers(parent, pool, handles.size(), handles.data());
+	return handles.size();
+}
+
+size_t vk::retirement_queue::collect_descriptor_pool(VkDescriptorPool pool) {
+	std::vector<VkDescriptorSet> handles;
+	{
+		std::lock_guard<std::mutex> lock(mut);
+		std::map<VkDescriptorPool, std::vector<VkDescriptorSet>>::iterator iter = passed_sets.find(pool);
+		if (iter == passed_sets.end()) return 0;
+		handles.swap(iter->second);
+		passed_sets.erase(iter);
+	}
+	parent.vkFreeDescriptorSets(parent, pool, handles.size(), handles.data());
+	return handles.size();
+}
+
+size_t vk::retirement_queue::pending() const {
+	std::lock_guard<std::mutex> lock(mut);
+	size_t count = open.count();
+	for (closed_epoch const & e : closed) count += e.objects.count();
+	for (std::pair<VkCommandPool const, std::vector<VkCommandBuffer>> const & p : passed_command_buffers) count += p.second.size();
+	for (std::pair<VkDescriptorPool const, std::vector<VkDescriptorSet>> const & p : passed_sets) count += p.second.size();
+	return count;
+}
+
+void vk::retirement_queue::retire_buffer(VkBuffer h) {
+	std::lock_guard<std::mutex> lock(mut);
+	open.buffers.push_back(h);
+}
+
+void vk::retirement_queue::retire_image(VkImage h) {
+	std::lock_guard<std::mutex> lock(mut);
+	open.images.push_back(h);
+}
+
+void vk::retirement_queue::retire_image_view(VkImageView h) {
+	std::lock_guard<std::mutex> lock(mut);
+	open.views.push_back(h);
+}
+
+void vk::retirement_queue::retire_memory(VkDeviceMemory h, uint32_t mem_type, VkDeviceSize size, bool mapped) {
+	std::lock_guard<std::mutex> lock(mut);
+	open.memories.emplace_back(h, mem_type, size, mapped);
+}
+
+void vk::retirement_queue::retire_allocation(memory_allocation const & a) {
+	std::lock_guard<std::mutex> lock(mut);
+	open.allocations.push_back(a);
+}
+
+void vk::retirement_queue::retire_descriptor_set(VkDescriptorPool pool, VkDescriptorSet h) {
+	std::lock_guard<std::mutex> lock(mut);
+	open.sets.emplace_back(pool, h);
+}
+
+void vk::retirement_queue::retire_descriptor_pool(VkDescriptorPool h) {
+	std::lock_guard<std::mutex> lock(mut);
+	open.descriptor_pools.push_back(h);
+}
+
+void vk::retirement_queue::retire_command_buffer(VkCommandPool pool, VkCommandBuffer h) {
+	std::lock_guard<std::mutex> lock(mut);
+	open.command_buffers.emplace_back(pool, h);
+}
+
+void vk::retirement_queue::retire_command_pool(VkCommandPool h) {
+	std::lock_guard<std::mutex> lock(mut);
+	open.command_pools.push_back(h);
+}
+
+void vk::retirement_queue::retire_pipeline(VkPipeline h) {
+	std::lock_guard<std::mutex> lock(mut);
+	open.pipelines.push_back(h);
+}
+
+void vk::retirement_queue::forget(memory_heap const * heap) {
+	std::lock_guard<std::mutex> lock(mut);
+	auto drop = [heap](garbage & g){
+		g.allocations.erase(std::remove_if(g.allocations.begin(), g.allocations.end(), [heap](memory_allocation const & a){return a.heap == heap;}), g.allocations.end());
+	};
+	drop(open);
+	for (closed_epoch & e : closed) drop(e.objects);
+}
+
+//children before what they were allocated from or bound to, one call per pool where vulkan can free many at once;
+//pool children only reach here from the destructor
+void vk::retirement_queue::free(garbage & g) {
+	std::sort(g.command_buffers.begin(), g.command_buffers.end());
+	std::vector<VkCommandBuffer> command_buffers;
+	for (size_t i = 0; i < g.command_buffers.size();) {
+		VkCommandPool pool = g.command_buffers[i].first;
+		command_buffers.clear();
+		for (; i < g.command_buffers.size() && g.command_buffers[i].first == pool; i++) command_buffers.push_back(g.command_buffers[i].second);
+		parent.vkFreeCommandBuffers(parent, pool, command_buffers.size(), command_buffers.data());
+	}
+	std::sort(g.sets.begin(), g.sets.end());
+	std::vector<VkDescriptorSet> sets;
+	for (size_t i = 0; i < g.sets.size();) {
+		VkDescriptorPool pool = g.sets[i].first;
+		sets.clear();
+		for (; i < g.sets.size() && g.sets[i].first == pool; i++) sets.push_back(g.sets[i].second);
+		parent.vkFreeDescriptorSets(parent, pool, sets.size(), sets.data());
+	}
+	for (VkPipeline h : g.pipelines) parent.vkDestroyPipeline(parent, h, nullptr);
+	for (VkImageView h : g.views) parent.vkDestroyImageView(parent, h, nullptr);
+	for (VkBuffer h : g.buffers) parent.vkDestroyBuffer(parent, h, nullptr);
+	for (VkImage h : g.images) parent.vkDestroyImage(parent, h, nullptr);
+	for (memory_allocation & a : g.allocations) a.heap->free(a); //may release whole blocks, which retire their memory into the open epoch
+	for (std::tuple<VkDeviceMemory, uint32_t, VkDeviceSize, bool> const & m : g.memories) {
+		if (std::get<3>(m)) parent.vkUnmapMemory(parent, std::get<0>(m));
+		parent.vkFreeMemory(parent, std::get<0>(m), nullptr);
+		parent.budget.freed(std::get<1>(m), std::get<2>(m));
+	}
+	for (VkDescriptorPool h : g.descriptor_pools) parent.vkDestroyDescriptorPool(parent, h, nullptr);
+	for (VkCommandPool h : g.command_pools) parent.vkDestroyCommandPool(parent, h, nullptr);
+}
@@ -0,0 +1,161 @@
+#include "vulkanomics.hpp"
+#include "vk_internal.hpp"
+
+vk::staging_ring::staging_ring(device const & parent, queue_accessor & queue, VkDeviceSize size, uint32_t max_batches) :
+	parent(parent),
+	queue(queue),
+	size_(size),
+	buf(parent, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT),
+	mem(parent, parent.parent.find_staging_memory(buf.memory_requirements().memoryTypeBits), std::vector<vk::memory_bound_structure *> {&buf}),
+	pool(parent, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT, queue.queue_family),
+	base(reinterpret_cast<uint8_t *>(buf.data())),
+	batches(max_batches)
+{
+	if (!max_batches) srcthrow("staging ring requires at least one batch");
+	for (batch & b : batches) {
+		b.cmd.reset(new command::buffer {pool});
+		b.done.reset(new vk::fence {parent});
+	}
+}
+
+vk::staging_ring::~staging_ring() {
+	while (in_flight) retire_oldest();
+}
+
+void vk::staging_ring::retire_oldest() {
+	batch & b = batches[oldest];
+	b.done->wait();
+	b.done->reset();
+	tail = b.end;
+	oldest = (oldest + 1) % batches.size();
+	in_flight--;
+}
+
+void vk::staging_ring::reclaim() {
+	while (in_flight && batches[oldest].done->signaled()) retire_oldest();
+}
+
+vk::staging_ring::slice vk::staging_ring::reserve(VkDeviceSize size, VkDeviceSize alignment) {
+	if (size > size_) srcthrow("staging reservation of %llu bytes exceeds the ring size of %llu bytes", static_cast<unsigned long long>(size), static_cast<unsigned long long>(size_));
+	for (;;) {
+		if (head == tail && !in_flight) head = tail = next_alignment(head, size_); //empty, restart at the beginning of the ring; a batch in flight would move tail back to its end
+		VkDeviceSize phys = head % size_;
+		VkDeviceSize offset = next_alignment(phys, alignment);
+		uint64_t begin = head + offset - phys;
+		if (offset + size > size_) { //does not fit before the end, skip the remainder
+			begin = head + size_ - phys;
+			offset = 0;
+		}
+		if (begin + size - tail <= size_) {
+			head = begin + size;
+			reserved.push_back(begin);
+			buf.mark_dirty(offset, size);
+			slice s;
+			s.data = base + offset;
+			s.offset = offset;
+			s.size = size;
+			s.position = begin;
+			return s;
+		}
+		if (!in_flight) { //only unsubmitted uploads are holding the ring
+			uint64_t releasable = reserved.empty() ? head : reserved.front();
+			if (releasable == tail) srcthrow("staging reservation of %llu bytes does not fit beside %zu slices not yet copied", static_cast<unsigned long long>(size), reserved.size());
+			submit();
+		}
+		retire_oldest();
+	}
+}
+
+//the slice may be submitted from now on, copying it again is harmless
+static inline void release_reservation(std::vector<uint64_t> & reserved, uint64_t position) {
+	std::vector<uint64_t>::iterator r = std::find(reserved.begin(), reserved.end(), position);
+	if (r != reserved.end()) reserved.erase(r);
+}
+
+void vk::staging_ring::copy(slice const & s, vk::buffer & dst, VkDeviceSize dst_offset) {
+	release_reservation(reserved, s.position);
+	buffer_copy c;
+	c.dst = &dst;
+	c.region.srcOffset = s.offset;
+	c.region.dstOffset = dst_offset;
+	c.region.size = s.size;
+	c.sequence = buffer_copies.size();
+	buffer_copies.push_back(c);
+}
+
+void vk::staging_ring::copy(slice const & s, vk::image & dst, VkImageLayout dst_layout, VkBufferImageCopy region) {
+	release_reservation(reserved, s.position);
+	region.bufferOffset += s.offset;
+	image_copies.push_back({&dst, dst_layout, region});
+}
+
+void vk::staging_ring::upload(vk::buffer & dst, VkDeviceSize dst_offset, void const * src, VkDeviceSize size) {
+	slice s = reserve(size);
+	memcpy(s.data, src, size);
+	copy(s, dst, dst_offset);
+}
+
+void vk::staging_ring::upload(vk::image & dst, VkImageLayout dst_layout, VkBufferImageCopy const & region, void const * src, VkDeviceSize size) {
+	slice s = reserve(size, std::max<VkDeviceSize>(16, parent.parent.properties.limits.optimalBufferCopyOffsetAlignment));
+	memcpy(s.data, src, size);
+	copy(s, dst, dst_layout, region);
+}
+
+static inline bool regions_overlap(VkBufferCopy const & a, VkBufferCopy const & b) {
+	return a.dstOffset < b.dstOffset + b.size && b.dstOffset < a.dstOffset + a.size;
+}
+
+void vk::staging_ring::submit(VkSemaphore const * signal, uint32_t signal_count) {
+	if (in_flight == batches.size()) retire_oldest();
+	batch & b = batches[(oldest + in_flight) % batches.size()];
+
+	mem.flush();
+	b.cmd->begin();
+
+	//one copy command per destination; writes to an already written range of it start a new command after a barrier, keeping upload order
+	std::sort(buffer_copies.begin(), buffer_copies.end(), [](buffer_copy const & a, buffer_copy const & b){return a.dst < b.dst || (a.dst == b.dst && a.sequence < b.sequence);}); //stable_sort would allocate
+	for (size_t i = 0; i < buffer_copies.size();) {
+		vk::buffer * dst = buffer_copies[i].dst;
+		regions_scratch.clear();
+		for (; i < buffer_copies.size() && buffer_copies[i].dst == dst; i++) {
+			VkBufferCopy const & region = buffer_copies[i].region;
+			if (std::any_of(regions_scratch.begin(), regions_scratch.end(), [&region](VkBufferCopy const & r){return regions_overlap(r, region);})) {
+				b.cmd->copy_buffer(buf, *dst, regions_scratch.data(), regions_scratch.size());
+				VkMemoryBarrier write_after_write = {VK_STRUCTURE_TYPE_MEMORY_BARRIER, nullptr, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_WRITE_BIT};
+				b.cmd->barrier(VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, &write_after_write, 1, nullptr, 0, nullptr, 0);
+				regions_scratch.clear();
+			}
+			regions_scratch.push_back(region);
+		}
+		b.cmd->copy_buffer(buf, *dst, regions_scratch.data(), regions_scratch.size());
+	}
+
+	for (size_t i = 0; i < image_copies.size();) {
+		size_t run = i + 1;
+		while (run < image_copies.size() && image_copies[run].dst == image_copies[i].dst && image_copies[run].layout == image_copies[i].layout) run++;
+		image_regions_scratch.clear();
+		for (size_t j = i; j < run; j++) image_regions_scratch.push_back(image_copies[j].region);
+		b.cmd->copy_buffer_to_image(buf, *image_copies[i].dst, image_copies[i].layout, image_regions_scratch.data(), image_regions_scratch.size());
+		i = run;
+	}
+
+	b.cmd->end();
+
+	VkSubmitInfo submit_info = {
+		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+		.pNext = nullptr,
+		.waitSemaphoreCount = 0,
+		.pWaitSemaphores = nullptr,
+		.pWaitDstStageMask = nullptr,
+		.commandBufferCount = 1,
+		.pCommandBuffers = &b.cmd->handle,
+		.signalSemaphoreCount = signal_count,
+		.pSignalSemaphores = signal,
+	};
+	queue.submit(&submit_info, 1, *b.done);
+
+	b.end = reserved.empty() ? head : reserved.front(); //retiring the batch must not free a slice still being filled
+	in_flight++;
+	buffer_copies.clear();
+	image_copies.clear();
+}
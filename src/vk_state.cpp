@@ -0,0 +1,287 @@
+#include "vulkanomics.hpp"
+#include "vk_internal.hpp"
+
+static constexpr VkAccessFlags write_access_mask =
+	VK_ACCESS_SHADER_WRITE_BIT |
+	VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+	VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+	VK_ACCESS_TRANSFER_WRITE_BIT |
+	VK_ACCESS_HOST_WRITE_BIT |
+	VK_ACCESS_MEMORY_WRITE_BIT;
+
+constexpr VkImageSubresourceRange vk::state_tracker::whole_image;
+
+void vk::state_tracker::access(vk::buffer const & buf, VkPipelineStageFlags stages, VkAccessFlags access, VkDeviceSize offset, VkDeviceSize size) {
+	if (offset > buf.size()) srcthrow("offset %llu is past the end of a buffer of %llu bytes", static_cast<unsigned long long>(offset), static_cast<unsigned long long>(buf.size()));
+	if (size == VK_WHOLE_SIZE) size = buf.size() - offset;
+	if (!size) return;
+	pending.push_back({&buf, nullptr, VK_IMAGE_LAYOUT_UNDEFINED, stages, access, offset, size, {}});
+}
+
+void vk::state_tracker::access(vk::image & img, VkImageLayout layout, VkPipelineStageFlags stages, VkAccessFlags access, VkImageSubresourceRange range) {
+	if (!range.aspectMask) range.aspectMask = img.aspects();
+	if (range.levelCount == VK_REMAINING_MIP_LEVELS) range.levelCount = img.mip_levels() - std::min(range.baseMipLevel, img.mip_levels());
+	if (range.layerCount == VK_REMAINING_ARRAY_LAYERS) range.layerCount = img.layers() - std::min(range.baseArrayLayer, img.layers());
+	if (range.baseMipLevel + range.levelCount > img.mip_levels() || range.baseArrayLayer + range.layerCount > img.layers()) srcthrow("subresource range exceeds the %u mip levels and %u layers of the image", img.mip_levels(), img.layers());
+	if (!range.levelCount || !range.layerCount) return;
+	pending.push_back({nullptr, &img, layout, stages, access, 0, 0, range});
+}
+
+//adds what must happen before an access to the barrier's source scope
+void vk::state_tracker::hazard(access_state const & st, VkPipelineStageFlags stages, VkAccessFlags access, bool write, VkPipelineStageFlags & src_stages, VkAccessFlags & src_access) {
+	if (write) { //after earlier writes and reads, reads only need their execution to be done
+		src_stages |= st.write_stages | st.read_stages;
+		src_access |= st.write_access;
+		return;
+	}
+	if (!st.write_stages) return;
+	if ((st.visible_stages & stages) == stages && (st.visible_access & access) == access) return; //an earlier barrier already covers it
+	src_stages |= st.write_stages;
+	src_access |= st.write_access;
+}
+
+void vk::state_tracker::apply(access_state & st, VkPipelineStageFlags stages, VkAccessFlags access, bool write) {
+	if (write) {
+		st.write_stages = stages;
+		st.write_access = access & write_access_mask;
+		st.read_stages = 0;
+		//a layout transition is made visible by its own barrier, a real write is not visible to anything yet
+		st.visible_stages = st.write_access ? 0 : stages;
+		st.visible_access = st.write_access ? 0 : access;
+	} else {
+		st.read_stages |= stages;
+		st.visible_stages |= stages;
+		st.visible_access |= access;
+	}
+}
+
+void vk::state_tracker::apply(pending_access const & p, bool write) {
+	std::vector<buffer_range> & ranges = buffers[p.buf];
+	VkDeviceSize begin = p.offset, end = p.offset + p.size;
+	
+	//rebuilds the ranges with [begin, end) split out of them and its gaps filled
+	ranges_scratch.clear();
+	VkDeviceSize cursor = begin;
+	for (buffer_range const & r : ranges) {
+		if (r.end <= begin || r.begin >= end) {
+			if (r.begin >= end && cursor < end) {
+				buffer_range gap {cursor, end, {}};
+				apply(gap.state, p.stages, p.access, write);
+				ranges_scratch.push_back(gap);
+				cursor = end;
+			}
+			ranges_scratch.push_back(r);
+			continue;
+		}
+		if (r.begin < begin) ranges_scratch.push_back({r.begin, begin, r.state});
+		if (r.begin > cursor) {
+			buffer_range gap {cursor, r.begin, {}};
+			apply(gap.state, p.stages, p.access, write);
+			ranges_scratch.push_back(gap);
+		}
+		buffer_range inside {std::max(r.begin, begin), std::min(r.end, end), r.state};
+		apply(inside.state, p.stages, p.access, write);
+		ranges_scratch.push_back(inside);
+		cursor = inside.end;
+		if (r.end > end) ranges_scratch.push_back({end, r.end, r.state});
+	}
+	if (cursor < end) {
+		buffer_range gap {cursor, end, {}};
+		apply(gap.state, p.stages, p.access, write);
+		ranges_scratch.push_back(gap);
+	}
+	
+	//merges neighbors left in the same state
+	ranges.clear();
+	for (buffer_range const & r : ranges_scratch) {
+		if (ranges.size()) {
+			buffer_range & last = ranges.back();
+			if (last.end == r.begin && last.state == r.state) {
+				last.end = r.end;
+				continue;
+			}
+		}
+		ranges.push_back(r);
+	}
+}
+
+vk::state_tracker::image_state & vk::state_tracker::track(vk::image & img) {
+	std::map<vk::image const *, image_state>::iterator iter = images.find(&img);
+	if (iter != images.end()) return iter->second;
+	image_state & is = images[&img];
+	is.subresources.resize(img.mip_levels() * img.layers(), {img.layout(), {}});
+	return is;
+}
+
+//merges the per subresource transitions from first on, first along layers and then along mip levels
+void vk::state_tracker::coalesce(size_t first) {
+	size_t end = first;
+	for (size_t i = first; i < image_barriers.size(); i++) {
+		VkImageMemoryBarrier const & b = image_barriers[i];
+		if (end > first) {
+			VkImageMemoryBarrier & last = image_barriers[end - 1];
+			if (last.oldLayout == b.oldLayout && last.subresourceRange.baseMipLevel == b.subresourceRange.baseMipLevel && last.subresourceRange.baseArrayLayer + last.subresourceRange.layerCount == b.subresourceRange.baseArrayLayer) {
+				last.subresourceRange.layerCount += b.subresourceRange.layerCount;
+				last.srcAccessMask |= b.srcAccessMask;
+				continue;
+			}
+		}
+		image_barriers[end++] = b;
+	}
+	image_barriers.resize(end);
+	
+	end = first;
+	for (size_t i = first; i < image_barriers.size(); i++) {
+		VkImageMemoryBarrier const & b = image_barriers[i];
+		if (end > first) {
+			VkImageMemoryBarrier & last = image_barriers[end - 1];
+			if (last.oldLayout == b.oldLayout && last.subresourceRange.baseArrayLayer == b.subresourceRange.baseArrayLayer && last.subresourceRange.layerCount == b.subresourceRange.layerCount && last.subresourceRange.baseMipLevel + last.subresourceRange.levelCount == b.subresourceRange.baseMipLevel) {
+				last.subresourceRange.levelCount += b.subresourceRange.levelCount;
+				last.srcAccessMask |= b.srcAccessMask;
+				continue;
+			}
+		}
+		image_barriers[end++] = b;
+	}
+	image_barriers.resize(end);
+}
+
+void vk::state_tracker::flush(command::buffer & cmd) {
+	if (pending.empty()) return;
+	VkPipelineStageFlags src_stages = 0, dst_stages = 0;
+	VkAccessFlags src_access = 0, dst_access = 0;
+	transitioned.clear();
+	image_barriers.clear();
+	
+	//every hazard is against the state before this flush, accesses declared together are used by the same command
+	for (size_t i = 0; i < pending.size(); i++) {
+		pending_access const & p = pending[i];
+		bool write = p.access & write_access_mask;
+		VkPipelineStageFlags hs = 0;
+		VkAccessFlags ha = 0;
+		
+		if (p.buf) {
+			std::map<vk::buffer const *, std::vector<buffer_range>>::iterator iter = buffers.find(p.buf);
+			if (iter != buffers.end()) for (buffer_range const & r : iter->second) {
+				if (r.end > p.offset && r.begin < p.offset + p.size) hazard(r.state, p.stages, p.access, write, hs, ha);
+			}
+		} else {
+			image_state & is = track(*p.img);
+			uint32_t layers = p.img->layers();
+			size_t first_barrier = image_barriers.size();
+			for (uint32_t level = p.range.baseMipLevel; level < p.range.baseMipLevel + p.range.levelCount; level++) {
+				for (uint32_t layer = p.range.baseArrayLayer; layer < p.range.baseArrayLayer + p.range.layerCount; layer++) {
+					uint32_t index = level * layers + layer;
+					subresource & sr = is.subresources[index];
+					if (sr.layout == p.layout) {
+						hazard(sr.state, p.stages, p.access, write, hs, ha);
+						continue;
+					}
+					for (std::pair<size_t, uint32_t> const & t : transitioned) {
+						if (pending[t.first].img == p.img && t.second == index) srcthrow("subresource (mip %u, layer %u) is used in two layouts by one command", level, layer);
+					}
+					VkPipelineStageFlags ts = 0;
+					VkAccessFlags ta = 0;
+					hazard(sr.state, p.stages, p.access, true, ts, ta);
+					hs |= ts;
+					VkImageMemoryBarrier b = {
+						.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+						.pNext = nullptr,
+						.srcAccessMask = ta,
+						.dstAccessMask = p.access,
+						.oldLayout = sr.layout,
+						.newLayout = p.layout,
+						.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+						.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+						.image = *p.img,
+						.subresourceRange = {p.range.aspectMask, level, 1, layer, 1},
+					};
+					image_barriers.push_back(b);
+					transitioned.emplace_back(i, index);
+					sr.layout = p.layout;
+				}
+			}
+			coalesce(first_barrier);
+			if (image_barriers.size() > first_barrier) dst_stages |= p.stages;
+		}
+		
+		if (hs || ha) {
+			src_stages |= hs;
+			src_access |= ha;
+			dst_stages |= p.stages;
+			dst_access |= p.access;
+		}
+	}
+	
+	if (src_stages || image_barriers.size()) {
+		VkMemoryBarrier mb = {
+			.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+			.pNext = nullptr,
+			.srcAccessMask = src_access,
+			.dstAccessMask = dst_access,
+		};
+		cmd.barrier(src_stages ? src_stages : static_cast<VkPipelineStageFlags>(VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT), dst_stages, &mb, src_access ? 1 : 0, nullptr, 0, image_barriers.data(), image_barriers.size());
+	}
+	
+	std::vector<std::pair<size_t, uint32_t>>::const_iterator t = transitioned.begin();
+	for (size_t i = 0; i < pending.size(); i++) {
+		pending_access const & p = pending[i];
+		bool write = p.access & write_access_mask;
+		if (p.buf) {
+			apply(p, write);
+			continue;
+		}
+		image_state & is = images[p.img];
+		uint32_t layers = p.img->layers();
+		for (uint32_t level = p.range.baseMipLevel; level < p.range.baseMipLevel + p.range.levelCount; level++) {
+			for (uint32_t layer = p.range.baseArrayLayer; layer < p.range.baseArrayLayer + p.range.layerCount; layer++) {
+				uint32_t index = level * layers + layer;
+				bool transition = t != transitioned.end() && t->first == i && t->second == index;
+				if (transition) t++;
+				apply(is.subresources[index].state, p.stages, p.access, write || transition);
+			}
+		}
+		VkImageLayout layout = is.subresources[0].layout;
+		if (std::all_of(is.subresources.begin(), is.subresources.end(), [layout](subresource const & sr){return sr.layout == layout;})) p.img->set_layout(layout);
+		else p.img->layout_tracked_ = false;
+	}
+	pending.clear();
+}
+
+void vk::state_tracker::dispatch(command::buffer & cmd, uint32_t x, uint32_t y, uint32_t z) {
+	flush(cmd);
+	cmd.dispatch(x, y, z);
+}
+
+void vk::state_tracker::draw(command::buffer & cmd, uint32_t vertex_count, uint32_t instance_count, uint32_t first_vertex, uint32_t first_instance) {
+	flush(cmd);
+	cmd.draw(vertex_count, instance_count, first_vertex, first_instance);
+}
+
+void vk::state_tracker::dispatch_indirect(command::buffer & cmd, vk::buffer const & args, VkDeviceSize offset) {
+	access(args, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT, offset, sizeof(VkDispatchIndirectCommand));
+	flush(cmd);
+	cmd.dispatch_indirect(args, offset);
+}
+
+void vk::state_tracker::draw_indirect(command::buffer & cmd, vk::buffer const & args, VkDeviceSize offset, uint32_t draw_count, uint32_t stride) {
+	if (draw_count) access(args, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT, offset, static_cast<VkDeviceSize>(stride) * (draw_count - 1) + sizeof(VkDrawIndirectCommand));
+	flush(cmd);
+	cmd.draw_indirect(args, offset, draw_count, stride);
+}
+
+void vk::state_tracker::forget(vk::buffer const & buf) {
+	buffers.erase(&buf);
+	pending.erase(std::remove_if(pending.begin(), pending.end(), [&buf](pending_access const & p){return p.buf == &buf;}), pending.end());
+}
+
+void vk::state_tracker::forget(vk::image const & img) {
+	images.erase(&img);
+	pending.erase(std::remove_if(pending.begin(), pending.end(), [&img](pending_access const & p){return p.img == &img;}), pending.end());
+}
+
+void vk::state_tracker::reset() {
+	buffers.clear();
+	images.clear();
+	pending.clear();
+}
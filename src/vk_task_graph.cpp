@@ -0,0 +1,390 @@
+#include "vulkanomics.hpp"
+#include "vk_internal.hpp"
+
+#include <queue>
+
+vk::task_graph::task_graph(device const & parent, std::vector<queue_accessor *> const & queues) : parent(parent), queues(queues) {
+	if (queues.empty()) srcthrow("task graph requires at least one queue");
+}
+
+vk::task_graph::~task_graph() {
+	wait();
+}
+
+vk::task_graph::node_id vk::task_graph::add(node && n) {
+	if (compiled) srcthrow("task graph cannot change after compile");
+	nodes.push_back(std::move(n));
+	return nodes.size() - 1;
+}
+
+vk::task_graph::node_id vk::task_graph::dispatch(char const * name, compute_pipeline const & pip, pipeline::layout const & layout, std::vector<descriptor::set const *> const & sets, uint32_t x, uint32_t y, uint32_t z, std::vector<vk::buffer const *> const & reads, std::vector<vk::buffer const *> const & writes) {
+	std::vector<VkDescriptorSet> handles;
+	for (descriptor::set const * s : sets) handles.push_back(*s);
+	node n;
+	n.name = name;
+	n.needs = device::capability::compute;
+	n.stages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	n.read_access = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_UNIFORM_READ_BIT;
+	n.write_access = VK_ACCESS_SHADER_WRITE_BIT;
+	n.reads = reads;
+	n.writes = writes;
+	compute_pipeline const * p = &pip;
+	pipeline::layout const * l = &layout;
+	n.record = [p, l, handles, x, y, z](command::buffer & cmd){
+		cmd.bind_compute_pipeline(*p);
+		if (handles.size()) cmd.bind_descriptor_sets(VK_PIPELINE_BIND_POINT_COMPUTE, *l, handles.data(), handles.size());
+		cmd.dispatch(x, y, z);
+	};
+	return add(std::move(n));
+}
+
+vk::task_graph::node_id vk::task_graph::copy(char const * name, vk::buffer const & src, vk::buffer & dst, VkBufferCopy const & region) {
+	node n;
+	n.name = name;
+	n.needs = device::capability::transfer;
+	n.stages = VK_PIPELINE_STAGE_TRANSFER_BIT;
+	n.read_access = VK_ACCESS_TRANSFER_READ_BIT;
+	n.write_access = VK_ACCESS_TRANSFER_WRITE_BIT;
+	n.reads = {&src};
+	n.writes = {&dst};
+	vk::buffer const * s = &src;
+	vk::buffer * d = &dst;
+	n.record = [s, d, region](command::buffer & cmd){
+		cmd.copy_buffer(*s, *d, &region, 1);
+	};
+	return add(std::move(n));
+}
+
+vk::task_graph::node_id vk::task_graph::custom(char const * name, device::capability::flags needs, VkPipelineStageFlags stages, VkAccessFlags read_access, VkAccessFlags write_access, std::vector<vk::buffer const *> const & reads, std::vector<vk::buffer const *> const & writes, std::function<void(command::buffer &)> record) {
+	node n;
+	n.name = name;
+	n.needs = needs;
+	n.stages = stages;
+	n.read_access = read_access;
+	n.write_access = write_access;
+	n.reads = reads;
+	n.writes = writes;
+	n.record = std::move(record);
+	return add(std::move(n));
+}
+
+void vk::task_graph::order(node_id before, node_id after) {
+	if (compiled) srcthrow("task graph cannot change after compile");
+	if (before >= nodes.size() || after >= nodes.size()) srcthrow("node does not exist");
+	nodes[after].after.push_back(before);
+}
+
+//the queue a node starts on soonest, preferring one that ran its predecessors, then one without capabilities it does not need
+uint32_t vk::task_graph::pick_queue(node const & n, std::vector<uint32_t> const & finish, std::vector<uint32_t> const & queue_free) const {
+	uint32_t ready = 0;
+	for (node_id u : n.after) ready = std::max(ready, finish[u]);
+	
+	uint32_t best = UINT32_MAX;
+	std::tuple<uint32_t, int, bool> best_key;
+	for (uint32_t q = 0; q < queues.size(); q++) {
+		device::capability::flags caps = queues[q]->cap_flags;
+		bool capable, dedicated;
+		if (n.needs == device::capability::transfer) { //every compute or graphics queue can transfer as well
+			capable = caps & (device::capability::transfer | device::capability::compute | device::capability::graphics);
+			dedicated = !(caps & (device::capability::compute | device::capability::graphics));
+		} else {
+			capable = (caps & n.needs) == n.needs;
+			dedicated = !(caps & ~n.needs & (device::capability::compute | device::capability::graphics));
+		}
+		if (!capable) continue;
+		int local = 0;
+		for (node_id u : n.after) if (nodes[u].queue == q) local++;
+		std::tuple<uint32_t, int, bool> key {std::max(ready, queue_free[q]), -local, !dedicated};
+		if (best == UINT32_MAX || key < best_key) {
+			best = q;
+			best_key = key;
+		}
+	}
+	if (best == UINT32_MAX) srcthrow("no queue is capable of node \"%s\"", n.name.c_str());
+	return best;
+}
+
+void vk::task_graph::compile() {
+	if (compiled) return;
+	size_t count = nodes.size();
+	
+	//hazard edges, in the order the nodes were added
+	std::map<vk::buffer const *, node_id> last_writer;
+	std::map<vk::buffer const *, std::vector<node_id>> readers;
+	for (node_id id = 0; id < count; id++) {
+		node & n = nodes[id];
+		for (vk::buffer const * b : n.reads) {
+			std::map<vk::buffer const *, node_id>::iterator w = last_writer.find(b);
+			if (w != last_writer.end()) n.after.push_back(w->second);
+		}
+		for (vk::buffer const * b : n.writes) {
+			std::map<vk::buffer const *, node_id>::iterator w = last_writer.find(b);
+			if (w != last_writer.end()) n.after.push_back(w->second);
+			for (node_id r : readers[b]) if (r != id) n.after.push_back(r);
+		}
+		for (vk::buffer const * b : n.reads) readers[b].push_back(id);
+		for (vk::buffer const * b : n.writes) {
+			last_writer[b] = id;
+			readers[b].clear();
+		}
+	}
+	
+	//topological order, ties going to the node added first
+	std::vector<std::vector<node_id>> successors(count);
+	std::vector<uint32_t> indegree(count, 0);
+	for (node_id id = 0; id < count; id++) {
+		std::vector<node_id> & after = nodes[id].after;
+		std::sort(after.begin(), after.end());
+		after.erase(std::unique(after.begin(), after.end()), after.end());
+		for (node_id u : after) successors[u].push_back(id);
+		indegree[id] = after.size();
+	}
+	std::priority_queue<node_id, std::vector<node_id>, std::greater<node_id>> ready;
+	for (node_id id = 0; id < count; id++) if (!indegree[id]) ready.push(id);
+	topo.clear();
+	while (!ready.empty()) {
+		node_id id = ready.top();
+		ready.pop();
+		topo.push_back(id);
+		for (node_id s : successors[id]) if (!--indegree[s]) ready.push(s);
+	}
+	if (topo.size() != count) srcthrow("task graph has a cycle");
+	
+	//queues, with the ownership transfers and dependencies they bring along
+	struct ownership {
+		node_id first;
+		uint32_t family;
+		std::vector<node_id> users; //since the family took ownership, in scheduling order
+	};
+	std::map<vk::buffer const *, ownership> owners;
+	//released after its last user, every user done before the acquire
+	auto transfer = [this](vk::buffer const * b, ownership & o, node_id id, uint32_t family) {
+		node & last = nodes[o.users.back()];
+		bool last_wrote = std::find(last.writes.begin(), last.writes.end(), b) != last.writes.end();
+		VkBufferMemoryBarrier release = {
+			.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+			.pNext = nullptr,
+			.srcAccessMask = last_wrote ? last.write_access : 0,
+			.dstAccessMask = 0,
+			.srcQueueFamilyIndex = o.family,
+			.dstQueueFamilyIndex = family,
+			.buffer = b->handle,
+			.offset = 0,
+			.size = VK_WHOLE_SIZE,
+		};
+		last.release.push_back(release);
+		node & n = nodes[id];
+		VkBufferMemoryBarrier acquire = release;
+		acquire.srcAccessMask = 0;
+		acquire.dstAccessMask = n.read_access | n.write_access;
+		n.acquire.push_back(acquire);
+		n.after.insert(n.after.end(), o.users.begin(), o.users.end());
+		o.family = family;
+		o.users = {id};
+	};
+	std::vector<uint32_t> finish(count, 0), queue_free(queues.size(), 0);
+	for (node_id id : topo) {
+		node & n = nodes[id];
+		n.queue = pick_queue(n, finish, queue_free);
+		uint32_t family = queues[n.queue]->queue_family;
+		
+		std::vector<vk::buffer const *> used = n.reads;
+		used.insert(used.end(), n.writes.begin(), n.writes.end());
+		std::sort(used.begin(), used.end());
+		used.erase(std::unique(used.begin(), used.end()), used.end());
+		for (vk::buffer const * b : used) {
+			std::map<vk::buffer const *, ownership>::iterator iter = owners.find(b);
+			if (iter == owners.end()) {
+				owners[b] = {id, family, {id}};
+				continue;
+			}
+			ownership & o = iter->second;
+			if (o.family == family) {
+				o.users.push_back(id);
+				continue;
+			}
+			transfer(b, o, id, family);
+		}
+		std::sort(n.after.begin(), n.after.end());
+		n.after.erase(std::unique(n.after.begin(), n.after.end()), n.after.end());
+		
+		uint32_t start = queue_free[n.queue];
+		for (node_id u : n.after) start = std::max(start, finish[u]);
+		finish[id] = queue_free[n.queue] = start + 1;
+	}
+	
+	//ownership handed back to the family of the first user at the end of every run, where the next run expects it,
+	//acquired by a closing node on the first user's queue
+	std::map<uint32_t, node_id> returns; //by queue
+	for (std::pair<vk::buffer const * const, ownership> & iter : owners) {
+		ownership & o = iter.second;
+		uint32_t queue = nodes[o.first].queue;
+		uint32_t family = queues[queue]->queue_family;
+		if (o.family == family) continue;
+		std::map<uint32_t, node_id>::iterator r = returns.find(queue);
+		if (r == returns.end()) {
+			node n;
+			n.name = "return ownership";
+			n.needs = 0;
+			n.stages = 0;
+			n.read_access = n.write_access = 0;
+			n.record = [](command::buffer &){};
+			n.queue = queue;
+			nodes.push_back(std::move(n));
+			r = returns.emplace(queue, nodes.size() - 1).first;
+			topo.push_back(r->second);
+		}
+		node & n = nodes[r->second];
+		node const & first = nodes[o.first];
+		n.stages |= first.stages;
+		n.read_access |= first.read_access;
+		n.write_access |= first.write_access;
+		transfer(iter.first, o, r->second, family);
+	}
+	for (std::pair<uint32_t const, node_id> const & r : returns) {
+		std::vector<node_id> & after = nodes[r.second].after;
+		std::sort(after.begin(), after.end());
+		after.erase(std::unique(after.begin(), after.end()), after.end());
+	}
+	successors.resize(nodes.size());
+	for (std::vector<node_id> & s : successors) s.clear();
+	for (node_id id : topo) for (node_id u : nodes[id].after) successors[u].push_back(id);
+	
+	//submissions, broken where a dependency crosses queues
+	std::vector<int64_t> open(queues.size(), -1);
+	for (node_id id : topo) {
+		node & n = nodes[id];
+		bool waits = std::any_of(n.after.begin(), n.after.end(), [this, &n](node_id u){return nodes[u].queue != n.queue;});
+		if (open[n.queue] < 0 || waits) {
+			submissions.emplace_back();
+			submissions.back().queue = n.queue;
+			open[n.queue] = submissions.size() - 1;
+		}
+		n.submission = open[n.queue];
+		submissions[n.submission].nodes.push_back(id);
+		if (std::any_of(successors[id].begin(), successors[id].end(), [this, &n](node_id s){return nodes[s].queue != n.queue;})) open[n.queue] = -1;
+	}
+	
+	//one semaphore per pair of submissions
+	std::map<std::pair<uint32_t, uint32_t>, size_t> waits; //to the index of the wait in the waiting submission
+	for (node_id id : topo) {
+		node const & n = nodes[id];
+		for (node_id u : n.after) {
+			if (nodes[u].queue == n.queue) continue;
+			std::pair<uint32_t, uint32_t> key {nodes[u].submission, n.submission};
+			submission & waiter = submissions[n.submission];
+			std::map<std::pair<uint32_t, uint32_t>, size_t>::iterator iter = waits.find(key);
+			if (iter != waits.end()) {
+				waiter.wait_stages[iter->second] |= n.stages;
+				continue;
+			}
+			semaphores.emplace_back(new vk::semaphore {parent});
+			submissions[key.first].signal_semaphores.push_back(*semaphores.back());
+			waits[key] = waiter.wait_semaphores.size();
+			waiter.waits_on.push_back(key.first);
+			waiter.wait_semaphores.push_back(*semaphores.back());
+			waiter.wait_stages.push_back(n.stages);
+		}
+	}
+	
+	//a barrier before a node depending on work of its own queue not yet made visible to the node's stages and accesses;
+	//a barrier only covers its destination scope, so earlier work stays pending for nodes in other stages
+	struct unsynced {
+		node_id id;
+		VkPipelineStageFlags covered_stages;
+		VkAccessFlags covered_access;
+	};
+	std::vector<std::vector<unsynced>> pending_work(queues.size());
+	for (node_id id : topo) {
+		node & n = nodes[id];
+		VkAccessFlags access = n.read_access | n.write_access;
+		std::vector<unsynced> & work = pending_work[n.queue];
+		auto uncovered = [&n, access](unsynced const & w){return (w.covered_stages & n.stages) != n.stages || (w.covered_access & access) != access;};
+		bool depends = std::any_of(work.begin(), work.end(), [&n, &uncovered](unsynced const & w){
+			return uncovered(w) && std::find(n.after.begin(), n.after.end(), w.id) != n.after.end();
+		});
+		if (depends) {
+			for (unsynced & w : work) {
+				if (!uncovered(w)) continue;
+				node const & u = nodes[w.id];
+				n.barrier_src |= u.stages;
+				if (u.writes.size()) n.barrier_src_access |= u.write_access;
+				w.covered_stages |= n.stages;
+				w.covered_access |= access;
+			}
+		}
+		work.push_back({id, 0, 0});
+	}
+	
+	for (submission & sub : submissions) {
+		uint32_t family = queues[sub.queue]->queue_family;
+		std::unique_ptr<command::pool> & pool = pools[family];
+		if (!pool) pool.reset(new command::pool {parent, 0, family});
+		sub.cmd.reset(new command::buffer {*pool});
+		sub.done.reset(new vk::fence {parent});
+		sub.cmd->begin(0); //resubmitted by every run, once the previous one has retired
+		for (node_id id : sub.nodes) {
+			node const & n = nodes[id];
+			if (n.barrier_src || n.acquire.size()) {
+				VkMemoryBarrier mb = {VK_STRUCTURE_TYPE_MEMORY_BARRIER, nullptr, n.barrier_src_access, n.read_access | n.write_access};
+				VkPipelineStageFlags src = n.barrier_src ? n.barrier_src : static_cast<VkPipelineStageFlags>(VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+				sub.cmd->barrier(src, n.stages, &mb, n.barrier_src ? 1 : 0, n.acquire.data(), n.acquire.size(), nullptr, 0);
+			}
+			n.record(*sub.cmd);
+			if (n.release.size()) sub.cmd->barrier(n.stages, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, nullptr, 0, n.release.data(), n.release.size(), nullptr, 0);
+		}
+		sub.cmd->end();
+	}
+	compiled = true;
+}
+
+void vk::task_graph::submit() {
+	compile();
+	wait();
+	for (submission & sub : submissions) {
+		VkSubmitInfo submit_info = {
+			.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+			.pNext = nullptr,
+			.waitSemaphoreCount = static_cast<uint32_t>(sub.wait_semaphores.size()),
+			.pWaitSemaphores = sub.wait_semaphores.data(),
+			.pWaitDstStageMask = sub.wait_stages.data(),
+			.commandBufferCount = 1,
+			.pCommandBuffers = &sub.cmd->handle,
+			.signalSemaphoreCount = static_cast<uint32_t>(sub.signal_semaphores.size()),
+			.pSignalSemaphores = sub.signal_semaphores.data(),
+		};
+		queues[sub.queue]->submit(&submit_info, 1, *sub.done);
+	}
+	pending = true;
+}
+
+void vk::task_graph::wait() {
+	if (!pending) return;
+	for (submission & sub : submissions) {
+		sub.done->wait();
+		sub.done->reset();
+	}
+	pending = false;
+}
+
+std::string vk::task_graph::trace() const {
+	std::string out;
+	for (size_t s = 0; s < submissions.size(); s++) {
+		submission const & sub = submissions[s];
+		out += "submission " + std::to_string(s) + " on queue " + std::to_string(sub.queue) + " (family " + std::to_string(queues[sub.queue]->queue_family) + ")";
+		if (sub.waits_on.size()) {
+			out += " after";
+			for (uint32_t w : sub.waits_on) out += " " + std::to_string(w);
+		}
+		out += "\n";
+		for (node_id id : sub.nodes) {
+			node const & n = nodes[id];
+			out += "\t" + std::to_string(id) + " " + n.name;
+			if (n.barrier_src) out += " [barrier]";
+			if (n.acquire.size()) out += " [acquires " + std::to_string(n.acquire.size()) + "]";
+			if (n.release.size()) out += " [releases " + std::to_string(n.release.size()) + "]";
+			out += "\n";
+		}
+	}
+	return out;
+}
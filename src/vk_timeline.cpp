@@ -0,0 +1,135 @@
+#include "vulkanomics.hpp"
+#include "vk_internal.hpp"
+
+vk::timeline_semaphore::timeline_semaphore(device const & parent, uint64_t initial_value) : parent(parent) {
+	if (!parent.vkWaitSemaphoresKHR) srcthrow("timeline semaphores require VK_KHR_timeline_semaphore");
+	VkSemaphoreTypeCreateInfoKHR type = {
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR,
+		.pNext = nullptr,
+		.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE_KHR,
+		.initialValue = initial_value,
+	};
+	VkSemaphoreCreateInfo create = {
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+		.pNext = &type,
+		.flags = 0,
+	};
+	VKR(parent.vkCreateSemaphore(parent, &create, nullptr, &handle))
+}
+
+vk::timeline_semaphore::~timeline_semaphore() {
+	if (handle) parent.vkDestroySemaphore(parent, handle, nullptr);
+}
+
+uint64_t vk::timeline_semaphore::value() const {
+	uint64_t v;
+	VKR(parent.vkGetSemaphoreCounterValueKHR(parent, handle, &v))
+	return v;
+}
+
+bool vk::timeline_semaphore::wait(uint64_t value, uint64_t timeout) const {
+	VkSemaphoreWaitInfoKHR info = {
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR,
+		.pNext = nullptr,
+		.flags = 0,
+		.semaphoreCount = 1,
+		.pSemaphores = &handle,
+		.pValues = &value,
+	};
+	VkResult res = parent.vkWaitSemaphoresKHR(parent, &info, timeout);
+	if (res == VK_TIMEOUT) return false;
+	VKR(res)
+	return true;
+}
+
+void vk::timeline_semaphore::signal(uint64_t value) {
+	VkSemaphoreSignalInfoKHR info = {
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SIGNAL_INFO_KHR,
+		.pNext = nullptr,
+		.semaphore = handle,
+		.value = value,
+	};
+	VKR(parent.vkSignalSemaphoreKHR(parent, &info))
+}
+
+bool vk::gpu_future::ready() const {
+	return !timeline || timeline->value() >= value;
+}
+
+bool vk::gpu_future::wait(uint64_t timeout) const {
+	return !timeline || timeline->wait(value, timeout);
+}
+
+bool vk::gpu_future::wait(gpu_future const * futures, uint32_t count, bool any, uint64_t timeout) {
+	inline_vector<VkSemaphore, 16> semaphores;
+	inline_vector<uint64_t, 16> values;
+	device const * dev = nullptr;
+	for (uint32_t i = 0; i < count; i++) {
+		if (!futures[i].timeline) {
+			if (any) return true;
+			continue;
+		}
+		if (dev && dev != &futures[i].timeline->parent) srcthrow("futures of different devices cannot be waited on together");
+		dev = &futures[i].timeline->parent;
+		semaphores.push_back(*futures[i].timeline);
+		values.push_back(futures[i].value);
+	}
+	if (!dev) return true;
+	VkSemaphoreWaitInfoKHR info = {
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR,
+		.pNext = nullptr,
+		.flags = any ? static_cast<VkSemaphoreWaitFlags>(VK_SEMAPHORE_WAIT_ANY_BIT_KHR) : 0,
+		.semaphoreCount = static_cast<uint32_t>(semaphores.size()),
+		.pSemaphores = semaphores.data(),
+		.pValues = values.data(),
+	};
+	VkResult res = dev->vkWaitSemaphoresKHR(*dev, &info, timeout);
+	if (res == VK_TIMEOUT) return false;
+	VKR(res)
+	return true;
+}
+
+vk::timeline_queue::timeline_queue(device const & parent, queue_accessor & queue) : parent(parent), queue(queue), timeline(parent) {}
+
+vk::gpu_future vk::timeline_queue::submit(VkCommandBuffer const * cmds, uint32_t cmd_count, gpu_future const * waits, VkPipelineStageFlags const * wait_stages, uint32_t wait_count, VkFence fence) {
+	inline_vector<VkSemaphore, 8> wait_semaphores;
+	inline_vector<uint64_t, 8> wait_values;
+	inline_vector<VkPipelineStageFlags, 8> stages;
+	for (uint32_t i = 0; i < wait_count; i++) {
+		if (!waits[i].timeline) continue;
+		wait_semaphores.push_back(*waits[i].timeline);
+		wait_values.push_back(waits[i].value);
+		stages.push_back(wait_stages[i]);
+	}
+	VkSemaphore signal = timeline;
+	
+	std::lock_guard<std::mutex> lock(mut);
+	uint64_t value = submitted + 1;
+	VkTimelineSemaphoreSubmitInfoKHR timeline_info = {
+		.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR,
+		.pNext = nullptr,
+		.waitSemaphoreValueCount = static_cast<uint32_t>(wait_values.size()),
+		.pWaitSemaphoreValues = wait_values.data(),
+		.signalSemaphoreValueCount = 1,
+		.pSignalSemaphoreValues = &value,
+	};
+	VkSubmitInfo submit_info = {
+		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+		.pNext = &timeline_info,
+		.waitSemaphoreCount = static_cast<uint32_t>(wait_semaphores.size()),
+		.pWaitSemaphores = wait_semaphores.data(),
+		.pWaitDstStageMask = stages.data(),
+		.commandBufferCount = cmd_count,
+		.pCommandBuffers = cmds,
+		.signalSemaphoreCount = 1,
+		.pSignalSemaphores = &signal,
+	};
+	queue.submit(&submit_info, 1, fence);
+	submitted = value;
+	return {&timeline, value};
+}
+
+vk::gpu_future vk::timeline_queue::last() const {
+	std::lock_guard<std::mutex> lock(mut);
+	return {&timeline, submitted};
+}
@@ -1,9 +1,21 @@
 #pragma once
 
 #include <mutex>
+#include <thread>
+#include <future>
+#include <memory>
 #include <vector>
+#include <functional>
+#include <condition_variable>
 #include <stdexcept>
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <tuple>
+#include <deque>
+#include <exception>
+#include <string>
 
 #include <xcb/xcb.h>
 
@@ -23,7 +35,35 @@ namespace vk {
 	
 	class exception : public std::runtime_error {
 	public:
-		exception(std::string const & str) : runtime_error(str) {}
+		VkResult result; //of the failed call, VK_SUCCESS for errors not reported by vulkan
+		exception(std::string const & str, VkResult result = VK_SUCCESS) : runtime_error(str), result(result) {}
+	};
+	
+	//contiguous storage for plain vulkan structures that stays inline up to N elements, clear() keeps any heap capacity for reuse
+	template <typename T, size_t N> struct inline_vector {
+		T * data() { return heap_.capacity() ? heap_.data() : inline_; }
+		T const * data() const { return heap_.capacity() ? heap_.data() : inline_; }
+		size_t size() const { return size_; }
+		bool empty() const { return !size_; }
+		T & operator [] (size_t i) { return data()[i]; }
+		T const & operator [] (size_t i) const { return data()[i]; }
+		T * begin() { return data(); }
+		T * end() { return data() + size_; }
+		void clear() { size_ = 0; heap_.clear(); }
+		void push_back(T const & v) {
+			if (heap_.capacity()) heap_.push_back(v);
+			else if (size_ < N) inline_[size_] = v;
+			else { //spills, from here on the heap holds everything
+				heap_.reserve(N * 2);
+				heap_.assign(inline_, inline_ + N);
+				heap_.push_back(v);
+			}
+			size_++;
+		}
+	private:
+		T inline_[N];
+		std::vector<T> heap_;
+		size_t size_ = 0;
 	};
 	
 //================================================================
@@ -33,6 +73,15 @@ namespace vk {
 	
 	struct device;
 	
+	enum class memory_profile : uint32_t {
+		gpu_only, //device local, not host visible where possible
+		cpu_to_gpu, //host visible, for uploads
+		gpu_to_cpu, //host visible preferring HOST_CACHED, for reads by the host
+		cpu_only, //host visible, not device local where possible
+		transient, //lazily allocated where possible, for attachments that never leave the device
+	};
+	static constexpr uint32_t memory_profile_count = 5;
+	
 	struct physical_device {
 		VkPhysicalDevice handle = VK_NULL_HANDLE;
 		VkPhysicalDeviceProperties properties;
@@ -42,14 +91,27 @@ namespace vk {
 		std::vector<VkBool32> queue_families_presentable;
 		VkPhysicalDeviceMemoryProperties memory_properties;
 		
-		uint32_t find_staging_memory(uint32_t restrict_mask = UINT32_MAX) const;
-		uint32_t find_device_memory(uint32_t restrict_mask = UINT32_MAX) const;
+		//most preferred memory type of the profile within restrict_mask, from tables built at construction
+		uint32_t find_memory(memory_profile, uint32_t restrict_mask = UINT32_MAX) const;
+		uint32_t memory_type_mask(memory_profile profile) const { return memory_policies[static_cast<uint32_t>(profile)].mask; } //types the profile can use
+		uint32_t find_staging_memory(uint32_t restrict_mask = UINT32_MAX) const; //cpu_to_gpu
+		uint32_t find_device_memory(uint32_t restrict_mask = UINT32_MAX) const; //gpu_only
+		uint32_t find_readback_memory(uint32_t restrict_mask = UINT32_MAX) const; //gpu_to_cpu
+		bool has_extension(char const *) const;
 		
 		physical_device() = delete;
 		physical_device(VkPhysicalDevice &);
 		physical_device(physical_device const &) = delete;
 		physical_device & operator = (physical_device const &) = delete;
 		physical_device(physical_device &&) = default;
+		
+	private:
+		struct memory_policy {
+			uint32_t mask;
+			uint8_t rank[VK_MAX_MEMORY_TYPES]; //0 is most preferred, UINT8_MAX where unusable
+			uint8_t best[4][256]; //most preferred type among the bits of each byte of a memoryTypeBits mask
+		} memory_policies[memory_profile_count];
+		void build_memory_policies();
 	};
 	
 	std::vector<vk::physical_device> const & get_physical_devices();
@@ -63,6 +125,7 @@ namespace vk {
 		void init(); //initialize without surface
 		void init(xcb_connection_t *, xcb_window_t &); //initialize with XCB surface
 		void term() noexcept;
+		bool has_extension(char const *); //enabled on the instance, including supported optional extensions
 	}
 	
 //================================================================
@@ -83,6 +146,60 @@ namespace vk {
 //================================================================
 // LOGICAL DEVICE
 	
+	struct retirement_queue;
+	
+	//live accounting of the vk::memory allocated on a device, cheap enough to always stay enabled
+	struct memory_budget {
+		
+		struct counter {
+			std::atomic<VkDeviceSize> bytes {0};
+			std::atomic<VkDeviceSize> peak {0};
+			std::atomic<uint32_t> count {0};
+		};
+		counter heaps[VK_MAX_MEMORY_HEAPS];
+		counter types[VK_MAX_MEMORY_TYPES];
+		
+		/*
+			With VK_EXT_memory_budget, budget and usage are those reported by the driver at the last refresh, usage advanced by
+			the allocations made since. Without it the budget is the size of the heap and the usage is what has been allocated here.
+		*/
+		bool driver_budget() const { return driver_budget_.load(std::memory_order_acquire); }
+		VkDeviceSize heap_budget(uint32_t heap) const;
+		VkDeviceSize heap_usage(uint32_t heap) const;
+		void refresh();
+		
+		//called once the usage of heap reaches fraction of its budget, and again only after it has dropped below since
+		typedef std::function<void(uint32_t heap, VkDeviceSize usage, VkDeviceSize budget)> pressure_callback;
+		uint32_t add_pressure_callback(uint32_t heap, float fraction, pressure_callback);
+		void remove_pressure_callback(uint32_t id);
+		
+		void allocated(uint32_t mem_type, VkDeviceSize size);
+		void freed(uint32_t mem_type, VkDeviceSize size);
+		
+		memory_budget() = delete;
+		memory_budget(device const & parent);
+		memory_budget(memory_budget const &) = delete;
+		
+	private:
+		struct pressure {
+			uint32_t id;
+			uint32_t heap;
+			float fraction;
+			pressure_callback cb;
+			bool fired;
+		};
+		device const & parent;
+		std::atomic_bool driver_budget_ {false}; //set by refresh(), read without the lock
+		std::atomic<VkDeviceSize> driver_heap_budget[VK_MAX_MEMORY_HEAPS];
+		std::atomic<VkDeviceSize> driver_heap_usage[VK_MAX_MEMORY_HEAPS]; //less the bytes allocated here at the time of the refresh
+		std::atomic<VkDeviceSize> trigger[VK_MAX_MEMORY_HEAPS]; //lowest usage at which an armed callback fires
+		std::atomic<VkDeviceSize> rearm[VK_MAX_MEMORY_HEAPS]; //highest usage below which a fired callback is armed again
+		std::vector<pressure> pressures;
+		uint32_t next_id = 0;
+		std::mutex mut;
+		void evaluate(uint32_t heap);
+	};
+	
 	struct device {
 		
 		struct capability { //ordered least important to most important, for sorting
@@ -124,7 +241,8 @@ namespace vk {
 			};
 			
 			initializer() = delete;
-			initializer(physical_device const &, capability_set const &);
+			//priorities, within [0, 1], are per requested capability; by default 1 for all but transfer-only queues, which get 0.5
+			initializer(physical_device const &, capability_set const &, std::vector<float> const & priorities = {});
 		};
 		
 		physical_device const & parent;
@@ -132,6 +250,8 @@ namespace vk {
 		capability::flags overall_capability;
 		std::vector<char const *> device_extensions;
 		std::vector<char const *> device_layers;
+		mutable memory_budget budget;
+		retirement_queue * retirement = nullptr; //set by a retirement_queue for its lifetime, destructors hand their handles to it
 		#define VK_FN_DDECL
 		#include "vulkanomics_fn.inl"
 		
@@ -143,6 +263,7 @@ namespace vk {
 		device & operator = (device const &) = delete;
 		bool operator == (device const & other) {return this->handle == other.handle;}
 		operator VkDevice const & () const { return handle; }
+		bool has_extension(char const *) const; //enabled on this device
 		
 		~device();
 		
@@ -160,7 +281,8 @@ namespace vk {
 		fence(device const & parent);
 		~fence();
 		void reset();
-		void wait(uint64_t timeout = UINT64_MAX);
+		bool wait(uint64_t timeout = UINT64_MAX) const; //false on timeout
+		bool signaled() const;
 		operator VkFence const & () const {return handle;}
 	private:
 		VkFence handle;
@@ -175,6 +297,96 @@ namespace vk {
 		VkSemaphore handle;
 	};
 	
+	struct timeline_semaphore;
+	
+	//a value on a timeline, complete once the counter of the semaphore reaches it; a future without a timeline is complete
+	struct gpu_future {
+		timeline_semaphore const * timeline = nullptr;
+		uint64_t value = 0;
+		bool ready() const; //never blocks
+		bool wait(uint64_t timeout = UINT64_MAX) const; //false on timeout
+		//one host wait for many futures of the same device, for all of them or any one, false on timeout
+		static bool wait(gpu_future const * futures, uint32_t count, bool any = false, uint64_t timeout = UINT64_MAX);
+	};
+	
+	/*
+		A semaphore with a 64 bit counter that only increases, from VK_KHR_timeline_semaphore. The device enables the
+		extension along with its timelineSemaphore feature whenever both are supported.
+	*/
+	struct timeline_semaphore {
+		device const & parent;
+		timeline_semaphore(device const & parent, uint64_t initial_value = 0);
+		~timeline_semaphore();
+		uint64_t value() const;
+		bool wait(uint64_t value, uint64_t timeout = UINT64_MAX) const; //false on timeout
+		void signal(uint64_t value); //from the host
+		gpu_future at(uint64_t value) const {return {this, value};}
+		operator VkSemaphore const & () const {return handle;}
+	private:
+		VkSemaphore handle = VK_NULL_HANDLE;
+	};
+	
+	//recycles fences instead of creating and destroying one per submit, released fences are reset in batches
+	struct fence_pool {
+		device const & parent;
+		
+		vk::fence & acquire(); //unsignaled
+		void release(vk::fence &); //signaled or never submitted
+		size_t size() const; //fences created so far
+		
+		fence_pool() = delete;
+		fence_pool(device const & parent) : parent(parent) {}
+		fence_pool(fence_pool const &) = delete;
+		fence_pool(fence_pool &&) = delete;
+		
+	private:
+		mutable std::mutex mut;
+		std::vector<std::unique_ptr<vk::fence>> fences;
+		std::vector<vk::fence *> available, released;
+		std::vector<VkFence> reset_scratch;
+	};
+	
+	/*
+		A thread waiting on every watched fence at once (vkWaitForFences with waitAll false) and running the
+		continuation of each one that signals, so requesters do not park a thread each. Fences watched while it waits
+		are picked up within poll_interval. Continuations run on the dispatcher thread and must not throw; they get
+		VK_SUCCESS, or the error of the wait if the device was lost. Fences are only watched once submitted, as the
+		destructor waits for every watched fence.
+	*/
+	struct completion_dispatcher {
+		device const & parent;
+		typedef std::function<void(VkResult)> continuation;
+		
+		void watch(VkFence, continuation);
+		void watch(vk::fence & pooled, continuation); //acquired from the pool, released to it after its continuation ran
+		size_t outstanding() const;
+		
+		completion_dispatcher() = delete;
+		completion_dispatcher(device const & parent, fence_pool & pool, std::chrono::microseconds poll_interval = std::chrono::microseconds {1000});
+		completion_dispatcher(completion_dispatcher const &) = delete;
+		completion_dispatcher(completion_dispatcher &&) = delete;
+		~completion_dispatcher();
+		
+	private:
+		struct watched {
+			VkFence handle;
+			vk::fence * pooled; //released to the pool once complete
+			continuation cb;
+		};
+		void dispatch();
+		
+		fence_pool & pool;
+		std::chrono::microseconds poll_interval;
+		std::vector<watched> incoming; //guarded by mut
+		std::vector<watched> watching; //dispatcher thread only
+		std::vector<VkFence> handles_scratch;
+		std::atomic<size_t> outstanding_ {0};
+		bool stopping = false;
+		mutable std::mutex mut;
+		std::condition_variable cv;
+		std::thread thread;
+	};
+	
 //================================================================
 //----------------------------------------------------------------
 //================================================================
@@ -210,6 +422,7 @@ namespace vk {
 	};
 	
 	class queue_accessor_mutexed : public queue_accessor {
+	public:
 		queue_accessor_mutexed(vk::device & parent, uint32_t index) : queue_accessor(parent, index) {}
 		~queue_accessor_mutexed() {}
 		void submit(VkSubmitInfo * infos, uint32_t infos_count, VkFence fence);
@@ -217,6 +430,73 @@ namespace vk {
 		std::mutex mut;
 	};
 	
+	/*
+		Submits from any number of threads go through a lock-free queue to a submitter thread, which merges whatever is
+		pending into one vkQueueSubmit. Once it has the first submit of a batch it keeps collecting for up to max_latency,
+		or until max_infos submit infos are gathered. A batch can carry only one fence, so a second fence starts the
+		next batch. submit() blocks until its batch is submitted and throws if the submission failed. The infos and
+		everything they point to only have to stay valid until then.
+	*/
+	class queue_accessor_coalescing : public queue_accessor {
+	public:
+		queue_accessor_coalescing(vk::device & parent, uint32_t index, std::chrono::microseconds max_latency = std::chrono::microseconds {50}, uint32_t max_infos = 64);
+		~queue_accessor_coalescing();
+		void submit(VkSubmitInfo * infos, uint32_t infos_count, VkFence fence);
+	private:
+		struct request {
+			std::atomic<request *> next {nullptr};
+			VkSubmitInfo const * infos = nullptr;
+			uint32_t infos_count = 0;
+			VkFence fence = VK_NULL_HANDLE;
+			VkResult result = VK_SUCCESS;
+			std::atomic_bool done {false};
+		};
+		
+		//intrusive multi-producer single-consumer queue (Vyukov), the producers own the requests
+		void push(request *);
+		request * pop();
+		bool empty() const;
+		request * pop_wait(); //nullptr once stopping with nothing left
+		void submitter();
+		void flush(std::vector<request *> & batch, VkFence fence);
+		
+		std::chrono::microseconds max_latency;
+		uint32_t max_infos;
+		request stub;
+		std::atomic<request *> head;
+		request * tail; //submitter only
+		std::vector<VkSubmitInfo> infos_scratch;
+		
+		std::atomic_bool idle {false}, stopping {false};
+		std::mutex mut_idle, mut_done;
+		std::condition_variable cv_idle, cv_done;
+		std::thread thread;
+	};
+	
+	/*
+		One timeline per queue. Every submit signals the next value of the timeline and returns it as a gpu_future, so
+		work in flight is tracked by a value rather than a fence each. Submits may wait on futures of any timeline.
+	*/
+	struct timeline_queue {
+		device const & parent;
+		
+		gpu_future submit(VkCommandBuffer const * cmds, uint32_t cmd_count, gpu_future const * waits = nullptr, VkPipelineStageFlags const * wait_stages = nullptr, uint32_t wait_count = 0, VkFence fence = VK_NULL_HANDLE);
+		gpu_future last() const; //of the newest submit
+		uint64_t completed() const {return timeline.value();}
+		timeline_semaphore const & semaphore() const {return timeline;}
+		
+		timeline_queue() = delete;
+		timeline_queue(device const & parent, queue_accessor & queue);
+		timeline_queue(timeline_queue const &) = delete;
+		timeline_queue(timeline_queue &&) = delete;
+		
+	private:
+		queue_accessor & queue;
+		timeline_semaphore timeline;
+		mutable std::mutex mut; //values have to reach the queue in order
+		uint64_t submitted = 0;
+	};
+	
 //================================================================
 //----------------------------------------------------------------
 //================================================================
@@ -238,20 +518,54 @@ namespace vk {
 // MEMORY
 	
 	struct memory;
+	struct memory_heap;
+	struct buffer;
+	struct image;
+	namespace command { struct buffer; }
+	
+	struct memory_allocation { friend struct memory_heap; friend struct memory_bound_structure; friend struct retirement_queue;
+		memory * block = nullptr;
+		VkDeviceSize offset = 0;
+		VkDeviceSize size = 0;
+		explicit operator bool () const { return block; }
+	private:
+		memory_heap * heap = nullptr;
+		uint32_t node = UINT32_MAX;
+	};
 	
-	struct memory_bound_structure {
+	struct memory_bound_structure { friend struct memory_heap; friend struct memory;
+		
+		enum class dedication { none, preferred, required };
 		
 		virtual VkMemoryRequirements memory_requirements() const = 0;
+		virtual dedication dedicated_allocation() const { return dedication::none; } //as reported through VK_KHR_dedicated_allocation
 		virtual void bind_to_memory(VkDeviceSize offset, vk::memory & mem) = 0;
+		virtual bool linear() const { return true; } //false when bufferImageGranularity applies against linear neighbors (optimally tiled images)
 		VkDeviceSize bound_offset() const { return bound_offset_; }
 		memory const * bound_memory() const { return bound_memory_; }
+		memory_allocation const & allocation() const { return allocation_; } //set when bound through a memory_heap
+		VkDeviceSize bound_size() const { return bound_size_; }
 		bool is_bound() const { return bound_memory_; }
-		void * map();
-		void unmap();
-		virtual ~memory_bound_structure() {}
+		
+		//ranges below are relative to the structure, VK_WHOLE_SIZE extends to its end
+		void * data(); //stable pointer into the persistent mapping of the bound memory
+		void mark_dirty(VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE);
+		void flush(VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE);
+		void invalidate(VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE);
+		void * map(); //data(), with the whole structure marked dirty
+		void unmap(); //flushes the dirty ranges of the bound memory
+		
+		virtual ~memory_bound_structure(); //returns the heap allocation, if any
 	protected:
+		//structures that can be relocated by memory_heap::defragment
+		virtual bool movable() const { return false; }
+		//replaces the handle with a new one bound at offset of mem and records the copy of the contents into cmd, the returned function destroys the old handle, or retires it into the queue it is given
+		virtual std::function<void(retirement_queue *)> move_to(command::buffer & cmd, vk::memory & mem, VkDeviceSize offset);
+		
 		memory * bound_memory_ = nullptr;
 		VkDeviceSize bound_offset_ = 0;
+		VkDeviceSize bound_size_ = 0;
+		memory_allocation allocation_ {};
 		memory_bound_structure() {}
 	};
 	
@@ -262,20 +576,46 @@ namespace vk {
 		
 		VkDeviceSize const & size() const {return size_;}
 		uint32_t memory_type() const { return mem_type_; }
+		bool host_coherent() const;
 		
-		void * map(VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE);
-		void unmap();
+		/*
+			Host visible memory is mapped once, on first use, and stays mapped until destruction.
+			For memory that is not HOST_COHERENT, writes are published by marking them dirty and flushing,
+			and device writes are made visible with invalidate. Ranges are widened to nonCoherentAtomSize,
+			dirty ranges are merged, and all of these are no-ops for coherent memory.
+		*/
+		void * data();
+		void mark_dirty(VkDeviceSize offset, VkDeviceSize size);
+		void flush(); //flushes every dirty range in one call
+		void flush(VkDeviceSize offset, VkDeviceSize size); //and forgets the range as dirty
+		void invalidate(VkDeviceSize offset, VkDeviceSize size);
+		void * map(VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE); //data() + offset, with the range marked dirty
+		void unmap(); //flush(), the mapping persists
 		
 		memory() = delete;
 		memory(device const & parent, uint32_t mem, VkDeviceSize size);
-		memory(device const & parent, uint32_t mem, std::vector<vk::memory_bound_structure *> const &);
+		memory(device const & parent, memory_profile, uint32_t type_bits, VkDeviceSize size); //falls back to the next type of the profile when out of device memory
+		memory(device const & parent, uint32_t mem, std::vector<vk::memory_bound_structure *> const &); //reorders placement to minimize padding, binds in bulk through VK_KHR_bind_memory2 when enabled
+		//an allocation of exactly one resource, bound to it, and declared dedicated to it with VK_KHR_dedicated_allocation when enabled
+		memory(device const & parent, uint32_t mem, vk::buffer & dedicated_to);
+		memory(device const & parent, uint32_t mem, vk::image & dedicated_to);
 		~memory();
 		
+		//packs structures into one allocation per memory type chosen by select from their memoryTypeBits
+		//structures preferring dedicated allocations get their own
+		static std::vector<std::unique_ptr<memory>> pack(device const & parent, std::vector<vk::memory_bound_structure *> const &, uint32_t (physical_device::*select)(uint32_t) const = &physical_device::find_device_memory);
+		VkDeviceSize wasted() const {return wasted_;} //alignment and granularity padding of a packed allocation
+		
 	private:
 		VkDeviceSize size_;
 		uint32_t mem_type_;
-		VkDeviceSize mapped_offset = 0;
-		VkDeviceSize mapped_size = 0;
+		VkDeviceSize wasted_ = 0;
+		void * mapped = nullptr;
+		void allocate(void const * next = nullptr);
+		void bind_all(std::vector<vk::memory_bound_structure *> const &, std::vector<VkMemoryRequirements> const &, std::vector<VkDeviceSize> const & offsets);
+		std::vector<VkMappedMemoryRange> dirty {}; //sorted, atom aligned, disjoint
+		std::mutex mut;
+		VkMappedMemoryRange atom_range(VkDeviceSize offset, VkDeviceSize size) const;
 	};
 	
 //================================================================
@@ -292,6 +632,7 @@ namespace vk {
 		
 		VkDeviceSize const & size() const {return size_;}
 		VkMemoryRequirements memory_requirements() const;
+		dedication dedicated_allocation() const;
 		void bind_to_memory(VkDeviceSize offset, vk::memory & mem);
 		VkDescriptorBufferInfo descript(VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE);
 	
@@ -299,12 +640,15 @@ namespace vk {
 		buffer(device const & parent, VkDeviceSize size, VkBufferUsageFlags usage);
 		~buffer();
 		
+	protected:
+		bool movable() const; //TRANSFER_SRC and TRANSFER_DST usage
+		std::function<void(retirement_queue *)> move_to(command::buffer & cmd, vk::memory & mem, VkDeviceSize offset);
 	private:
 		VkDeviceSize size_;
 		VkBufferUsageFlags usage_;
 	};
 	
-	struct image : public memory_bound_structure {
+	struct image : public memory_bound_structure { friend struct state_tracker; friend struct command::buffer;
 		
 		struct view {
 			image const & parent;
@@ -322,10 +666,18 @@ namespace vk {
 		VkImageUsageFlags const & usage() const {return usage_;}
 		VkFormat const & format() const {return format_;}
 		VkImageType const & image_type() const {return image_type_;}
-		VkImageLayout const & layout() const {return layout_;}
+		VkImageLayout const & layout() const {return layout_;} //of every subresource, when layout_tracked()
+		bool layout_tracked() const {return layout_tracked_;}
+		void set_layout(VkImageLayout layout) {layout_ = layout; layout_tracked_ = true;} //after transitions recorded outside of state_tracker and command::buffer::acquire
+		VkExtent3D const & extent() const {return create_info_.extent;}
+		uint32_t const & mip_levels() const {return create_info_.mipLevels;}
+		uint32_t const & layers() const {return create_info_.arrayLayers;}
+		VkImageAspectFlags aspects() const; //every aspect of the format
 		
 		VkMemoryRequirements memory_requirements() const;
+		dedication dedicated_allocation() const;
 		void bind_to_memory(VkDeviceSize offset, vk::memory & mem);
+		bool linear() const { return tiling_ == VK_IMAGE_TILING_LINEAR; }
 		
 		image() = delete;
 		image(
@@ -349,12 +701,221 @@ namespace vk {
 		virtual ~image();
 		
 		operator VkImage const & () const {return handle;}
+	protected:
+		bool movable() const; //TRANSFER_SRC and TRANSFER_DST usage and a tracked layout, the contents are copied in layout()
+		std::function<void(retirement_queue *)> move_to(command::buffer & cmd, vk::memory & mem, VkDeviceSize offset);
 	private:
 		VkImage handle = VK_NULL_HANDLE;
+		VkImageCreateInfo create_info_; //kept for recreation when moved
+		std::vector<uint32_t> queue_families_;
 		VkImageUsageFlags usage_;
 		VkFormat format_;
 		VkImageType image_type_;
+		VkImageTiling tiling_;
 		VkImageLayout layout_;
+		bool layout_tracked_ = false; //layout_ is only the initial layout until a transition is known
+	};
+	
+//================================================================
+//----------------------------------------------------------------
+//================================================================
+// MEMORY HEAP
+	
+	//suballocates memory_bound_structures out of large per-type blocks, one vkAllocateMemory per block
+	struct memory_heap {
+		
+		device const & parent;
+		
+		memory_allocation allocate(VkMemoryRequirements const & req, uint32_t mem_type, bool linear = true);
+		memory_allocation allocate(VkMemoryRequirements const & req, memory_profile, bool linear = true); //falls back to the next type of the profile when out of device memory
+		void free(memory_allocation &);
+		//the structure returns its range on destruction, so it must not outlive the heap
+		//buffers and images preferring a dedicated allocation, or larger than half a block, get a dedicated vk::memory instead
+		void bind(memory_bound_structure &, uint32_t mem_type);
+		void bind(memory_bound_structure &, memory_profile);
+		
+		size_t block_count(uint32_t mem_type) const;
+		VkDeviceSize block_size(uint32_t mem_type) const;
+		
+		//the moves of one defragment call, vacated ranges and replaced handles are released by finish
+		struct [[nodiscard]] defrag_pass { friend struct memory_heap;
+			size_t moves() const { return moved.size(); }
+			VkDeviceSize bytes_moved() const { return bytes; }
+			void finish(); //only once the command buffer holding the copies has completed
+			defrag_pass(defrag_pass &&) = default;
+			~defrag_pass(); //never frees: an unfinished pass retires its moves into the device's retirement_queue, or leaks them
+		private:
+			struct move {
+				memory_allocation vacated;
+				std::function<void(retirement_queue *)> release;
+			};
+			memory_heap * heap;
+			std::vector<move> moved;
+			VkDeviceSize bytes = 0;
+			defrag_pass(memory_heap & heap) : heap(&heap) {}
+		};
+		typedef std::function<void(memory_bound_structure &)> move_callback;
+		
+		/*
+			Incremental compaction. Structures bound through this heap are moved out of its most sparsely used blocks into
+			free ranges of denser blocks of the same type, until max_bytes have been moved. Every move rebinds a new handle
+			and records the copy of the contents into cmd, which must be submitted before the moved structures are used again.
+			on_move is called for every moved structure, so descriptors, views and mapped pointers referring to it can be updated.
+			Once cmd has completed, finish the returned pass so the vacated ranges can be reused.
+		*/
+		[[nodiscard]] defrag_pass defragment(command::buffer & cmd, VkDeviceSize max_bytes, move_callback const & on_move = {});
+		
+		memory_heap() = delete;
+		memory_heap(device const & parent, VkDeviceSize block_size = 0); //0 picks a block size per memory heap
+		memory_heap(memory_heap const &) = delete;
+		memory_heap(memory_heap &&) = delete;
+		~memory_heap();
+		
+	private:
+		struct block;
+		block * find_block(memory const *); //with mut held
+		void adopt(memory_bound_structure &, memory_allocation &);
+		static constexpr uint32_t dedicated_node = UINT32_MAX - 1; //node of allocations that are a whole dedicated memory
+		VkDeviceSize block_size_;
+		std::vector<std::unique_ptr<block>> blocks[VK_MAX_MEMORY_TYPES];
+		std::vector<std::unique_ptr<memory>> dedicated;
+		mutable std::mutex mut;
+	};
+	
+//================================================================
+//----------------------------------------------------------------
+//================================================================
+// RETIREMENT
+	
+	/*
+		Deferred destruction. While one exists, the destructors of buffers, images, views, memory, heap ranges,
+		descriptor sets and pools, command buffers and pools, and pipelines hand their handles to it instead of destroying
+		them. Handles are retired into the open epoch; close() ends the epoch with something that tells when the GPU has
+		passed it, and collect() frees every passed epoch in batches, in order, without blocking. Command buffers and
+		descriptor sets need their pool externally synchronized, so collect() only hands them to their pool, and they are
+		freed on the thread owning it the next time it allocates or resets (or through collect_command_pool and
+		collect_descriptor_pool). A fence closing an epoch must not be reset before collect() has seen it signaled. Destroying the queue waits for every closed epoch
+		and frees everything, the open epoch included, so the GPU has to be done with that as well.
+	*/
+	struct retirement_queue {
+		
+		device const & parent;
+		
+		uint64_t epoch() const; //the open one
+		uint64_t close(); //passed once passed() reaches it
+		uint64_t close(vk::fence const &); //passed once the fence signals
+		uint64_t close(gpu_future); //passed once the future is ready
+		void passed(uint64_t epoch); //the GPU is done with everything up to epoch
+		size_t collect(); //frees every passed epoch but pool children, from any thread; returns the number of handles freed
+		size_t collect_command_pool(VkCommandPool); //frees its passed command buffers, on the thread owning the pool
+		size_t collect_descriptor_pool(VkDescriptorPool); //frees its passed descriptor sets, on the thread owning the pool
+		size_t pending() const; //handles not yet freed
+		
+		void retire_buffer(VkBuffer);
+		void retire_image(VkImage);
+		void retire_image_view(VkImageView);
+		void retire_memory(VkDeviceMemory, uint32_t mem_type, VkDeviceSize size, bool mapped);
+		void retire_allocation(memory_allocation const &); //returned to its heap
+		void retire_descriptor_set(VkDescriptorPool, VkDescriptorSet);
+		void retire_descriptor_pool(VkDescriptorPool);
+		void retire_command_buffer(VkCommandPool, VkCommandBuffer);
+		void retire_command_pool(VkCommandPool);
+		void retire_pipeline(VkPipeline);
+		void forget(memory_heap const *); //drops the ranges of a heap being destroyed, its blocks go with it
+		
+		retirement_queue() = delete;
+		retirement_queue(device const & parent);
+		retirement_queue(retirement_queue const &) = delete;
+		retirement_queue(retirement_queue &&) = delete;
+		~retirement_queue();
+		
+	private:
+		struct garbage {
+			std::vector<VkBuffer> buffers;
+			std::vector<VkImage> images;
+			std::vector<VkImageView> views;
+			std::vector<std::tuple<VkDeviceMemory, uint32_t, VkDeviceSize, bool>> memories;
+			std::vector<memory_allocation> allocations;
+			std::vector<std::pair<VkDescriptorPool, VkDescriptorSet>> sets;
+			std::vector<VkDescriptorPool> descriptor_pools;
+			std::vector<std::pair<VkCommandPool, VkCommandBuffer>> command_buffers;
+			std::vector<VkCommandPool> command_pools;
+			std::vector<VkPipeline> pipelines;
+			size_t count() const;
+			void append(garbage &&);
+		};
+		struct closed_epoch {
+			uint64_t number;
+			VkFence fence;
+			gpu_future future;
+			garbage objects;
+		};
+		bool has_passed(closed_epoch const &) const;
+		void free(garbage &);
+		
+		mutable std::mutex mut;
+		uint64_t open_epoch = 1;
+		uint64_t passed_epoch = 0; //reported through passed()
+		garbage open;
+		std::deque<closed_epoch> closed;
+		std::map<VkCommandPool, std::vector<VkCommandBuffer>> passed_command_buffers; //waiting on their pool's thread
+		std::map<VkDescriptorPool, std::vector<VkDescriptorSet>> passed_sets;
+	};
+	
+//================================================================
+//----------------------------------------------------------------
+//================================================================
+// BUFFER CACHE
+	
+	/*
+		Recycles buffers bound through a memory_heap, keyed by usage, size class and memory profile. Sizes are rounded up
+		to classes a quarter power of two apart, so an acquired buffer may be larger than requested. A released buffer
+		is only handed out again once the timeline has passed the future of its last use, which no reset can hide. Without
+		VK_KHR_timeline_semaphore, release it with the fence of its last use instead; that fence must not be reset or
+		destroyed while the cache holds the buffer.
+	*/
+	struct buffer_cache {
+		
+		device const & parent;
+		
+		struct statistics {
+			uint64_t hits = 0;
+			uint64_t misses = 0;
+			size_t buffers = 0; //cached, including those waiting on their last use
+			VkDeviceSize bytes = 0;
+			double hit_rate() const { return hits + misses ? static_cast<double>(hits) / (hits + misses) : 0; }
+		};
+		
+		std::unique_ptr<vk::buffer> acquire(VkDeviceSize size, VkBufferUsageFlags usage, memory_profile profile = memory_profile::gpu_only);
+		void release(std::unique_ptr<vk::buffer>, gpu_future last_use = {}); //only buffers acquired from this cache
+		void release(std::unique_ptr<vk::buffer>, vk::fence const & last_use);
+		
+		//destroys retired buffers, least recently released first, until at most max_bytes are cached, and any idle for longer than max_idle
+		void trim(VkDeviceSize max_bytes, std::chrono::steady_clock::duration max_idle = std::chrono::steady_clock::duration::max());
+		void clear(); //destroys every retired buffer, never blocks; the destructor waits for the rest, or defers them to the device's retirement_queue
+		statistics stats() const;
+		static VkDeviceSize size_class(VkDeviceSize size);
+		
+		buffer_cache() = delete;
+		buffer_cache(memory_heap & heap);
+		buffer_cache(buffer_cache const &) = delete;
+		buffer_cache(buffer_cache &&) = delete;
+		~buffer_cache();
+		
+	private:
+		typedef std::tuple<VkBufferUsageFlags, VkDeviceSize, memory_profile> key;
+		struct entry {
+			std::unique_ptr<vk::buffer> buf;
+			gpu_future last_use;
+			VkFence last_use_fence; //instead of last_use when not VK_NULL_HANDLE
+			std::chrono::steady_clock::time_point released;
+		};
+		bool passed(entry const &) const;
+		void insert(std::unique_ptr<vk::buffer>, gpu_future, VkFence);
+		memory_heap & heap;
+		std::map<key, std::vector<entry>> entries; //by release order
+		statistics stats_;
+		mutable std::mutex mut;
 	};
 	
 //================================================================
@@ -372,7 +933,8 @@ namespace vk {
 			device const & parent;
 			
 			layout(device const & parent, VkPipelineLayoutCreateInfo const *);
-			layout(device const & parent, std::vector<VkDescriptorSetLayout>, std::vector<VkPushConstantRange>);
+			layout(device const & parent, std::vector<VkDescriptorSetLayout> const &, std::vector<VkPushConstantRange> const &);
+			layout(device const & parent, VkDescriptorSetLayout const * descriptor_sets, uint32_t descriptor_sets_count, VkPushConstantRange const * push_constants = nullptr, uint32_t push_constants_count = 0);
 			~layout();
 		};
 		
@@ -431,19 +993,77 @@ namespace vk {
 			VkDescriptorSet handle;
 		};
 		
+		//writes and copies are stored inline along with their buffer infos, so recording them does not allocate in the common case
 		struct update_session {
 			update_session(device const & p) : parent(p) {}
 			~update_session() = default;
 			void update();
+			void clear(); //for reuse, update() keeps what was recorded
 			void copy(set & src, set & dst, uint32_t src_binding, uint32_t dst_binding, uint32_t count = 1, uint32_t src_index = 0, uint32_t dst_index = 0);
 			void write_buffer(set &, uint32_t binding, uint32_t index, VkDescriptorType type, buffer_info_set const &);
+			void write_buffer(set &, uint32_t binding, uint32_t index, VkDescriptorType type, VkDescriptorBufferInfo const * infos, uint32_t infos_count); //the infos are copied
 		private:
+			static constexpr size_t inline_count = 16;
 			device const & parent;
-			std::vector<VkWriteDescriptorSet> wset {};
-			std::vector<VkCopyDescriptorSet> cset {};
+			inline_vector<VkWriteDescriptorSet, inline_count> wset {};
+			inline_vector<uint32_t, inline_count> wset_info {}; //first of each write in binfo, pointers are only taken in update()
+			inline_vector<VkDescriptorBufferInfo, inline_count> binfo {};
+			inline_vector<VkCopyDescriptorSet, inline_count> cset {};
 		};
 	}
 	
+//================================================================
+//----------------------------------------------------------------
+//================================================================
+// JOBS
+	
+	/*
+		A work-stealing thread pool. run() cuts a range of indices into tasks spread over per-worker queues, workers take
+		from the back of their own queue and steal from the front of the others' once it runs dry.
+	*/
+	struct job_system {
+		
+		typedef std::function<void(size_t begin, size_t end, uint32_t worker)> range_job;
+		
+		//blocks until every task has run, then rethrows the first exception any of them threw; a grain of 0 picks one
+		//throws if called from a job of this same system, which would block a worker on the workers
+		void run(size_t count, range_job const &, size_t grain = 0);
+		uint32_t workers() const { return static_cast<uint32_t>(threads.size()); }
+		
+		job_system(uint32_t workers = std::thread::hardware_concurrency());
+		job_system(job_system const &) = delete;
+		job_system(job_system &&) = delete;
+		~job_system();
+		
+	private:
+		struct batch {
+			range_job const * fn;
+			std::atomic<size_t> remaining;
+			std::exception_ptr error;
+			std::mutex error_mut;
+		};
+		struct task {
+			batch * b;
+			size_t begin, end;
+		};
+		struct worker_queue {
+			std::vector<task> tasks; //[front, end) are queued, the storage is kept across runs
+			size_t front = 0;
+			std::mutex mut;
+		};
+		
+		bool take(uint32_t self, task &);
+		void execute(task const &, uint32_t worker);
+		void work(uint32_t self);
+		
+		std::vector<std::unique_ptr<worker_queue>> queues;
+		std::vector<std::thread> threads;
+		std::atomic<size_t> pending {0}; //tasks queued and not yet taken
+		bool stopping = false;
+		std::mutex mut;
+		std::condition_variable cv_work, cv_done;
+	};
+	
 //================================================================
 //----------------------------------------------------------------
 //================================================================
@@ -457,7 +1077,12 @@ namespace vk {
 			VkCommandPool handle;
 			device const & parent;
 			
+			void reset(VkCommandPoolResetFlags flags = 0); //every buffer of the pool returns to the initial state
+			void allocate(VkCommandBuffer * handles, uint32_t count, VkCommandBufferLevel lev = VK_COMMAND_BUFFER_LEVEL_PRIMARY) const;
+			
 			pool(device const &, VkCommandPoolCreateFlags flags, uint32_t queue_family);
+			pool(pool const &) = delete;
+			pool(pool &&) = delete;
 			~pool();
 		};
 		
@@ -470,20 +1095,570 @@ namespace vk {
 			
 			void bind_compute_pipeline(compute_pipeline const &);
 			void bind_graphics_pipeline(graphics_pipeline const &);
-			void bind_descriptor_sets(VkPipelineBindPoint bind_point, pipeline::layout & layout, std::vector<descriptor::set const *> const & descriptors);
+			void bind_descriptor_sets(VkPipelineBindPoint bind_point, pipeline::layout const & layout, std::vector<descriptor::set const *> const & descriptors);
+			void bind_descriptor_sets(VkPipelineBindPoint bind_point, pipeline::layout const & layout, VkDescriptorSet const * sets, uint32_t sets_count, uint32_t first_set = 0, uint32_t const * dynamic_offsets = nullptr, uint32_t dynamic_offsets_count = 0);
+			void execute(VkCommandBuffer const * secondaries, uint32_t count);
+			void push_constants(pipeline::layout const & layout, VkShaderStageFlags stages, uint32_t offset, uint32_t size, void const * values);
 			void dispatch(uint32_t x, uint32_t y, uint32_t z);
+			void draw(uint32_t vertex_count, uint32_t instance_count = 1, uint32_t first_vertex = 0, uint32_t first_instance = 0);
+			void bind_index_buffer(vk::buffer const &, VkDeviceSize offset, VkIndexType type);
+			//arguments are read from the buffer when the command executes, see indirect_barrier
+			void dispatch_indirect(vk::buffer const & args, VkDeviceSize offset = 0);
+			void draw_indirect(vk::buffer const & args, VkDeviceSize offset, uint32_t draw_count, uint32_t stride = sizeof(VkDrawIndirectCommand));
+			void draw_indexed_indirect(vk::buffer const & args, VkDeviceSize offset, uint32_t draw_count, uint32_t stride = sizeof(VkDrawIndexedIndirectCommand));
+			//the draw count is read from count_buffer as well, up to max_draw_count; requires VK_KHR_draw_indirect_count
+			void draw_indirect_count(vk::buffer const & args, VkDeviceSize offset, vk::buffer const & count_buffer, VkDeviceSize count_offset, uint32_t max_draw_count, uint32_t stride = sizeof(VkDrawIndirectCommand));
+			void draw_indexed_indirect_count(vk::buffer const & args, VkDeviceSize offset, vk::buffer const & count_buffer, VkDeviceSize count_offset, uint32_t max_draw_count, uint32_t stride = sizeof(VkDrawIndexedIndirectCommand));
+			void fill_buffer(vk::buffer & dst, VkDeviceSize offset, VkDeviceSize size, uint32_t data);
+			//makes indirect arguments written by earlier commands in producer_stages visible to indirect commands after it
+			void indirect_barrier(VkPipelineStageFlags producer_stages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VkAccessFlags producer_access = VK_ACCESS_SHADER_WRITE_BIT);
+			/*
+				Queue family ownership transfers of exclusive resources. The release is recorded on a queue of src_family, the
+				matching acquire with the same families, range and layouts on a queue of dst_family, and a semaphore waited on
+				at dst_stages orders the two submissions. Between queues of the same family there is nothing to transfer, only
+				an image layout change is recorded by the acquire, after the earlier work of src_stages and src_access on its
+				queue. An image range with no aspects covers every aspect of the format; acquiring all of an image updates its
+				layout().
+			*/
+			void release(vk::buffer const &, uint32_t src_family, uint32_t dst_family, VkPipelineStageFlags src_stages, VkAccessFlags src_access, VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE);
+			void acquire(vk::buffer const &, uint32_t src_family, uint32_t dst_family, VkPipelineStageFlags dst_stages, VkAccessFlags dst_access, VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE);
+			void release(vk::image const &, uint32_t src_family, uint32_t dst_family, VkImageLayout old_layout, VkImageLayout new_layout, VkPipelineStageFlags src_stages, VkAccessFlags src_access, VkImageSubresourceRange range = {0, 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS});
+			void acquire(vk::image &, uint32_t src_family, uint32_t dst_family, VkImageLayout old_layout, VkImageLayout new_layout, VkPipelineStageFlags src_stages, VkAccessFlags src_access, VkPipelineStageFlags dst_stages, VkAccessFlags dst_access, VkImageSubresourceRange range = {0, 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS});
+			void copy_buffer(vk::buffer const & src, vk::buffer & dst, VkBufferCopy const * regions, uint32_t regions_count);
+			void copy_buffer_to_image(vk::buffer const & src, vk::image & dst, VkImageLayout dst_layout, VkBufferImageCopy const * regions, uint32_t regions_count);
+			void copy_image_to_buffer(vk::image const & src, VkImageLayout src_layout, vk::buffer & dst, VkBufferImageCopy const * regions, uint32_t regions_count);
 			void barrier(VkPipelineStageFlags stages_src, VkPipelineStageFlags stages_dst, std::vector<VkMemoryBarrier> const &, std::vector<VkBufferMemoryBarrier> const &, std::vector<VkImageMemoryBarrier> const &, VkDependencyFlags dep = 0);
+			void barrier(VkPipelineStageFlags stages_src, VkPipelineStageFlags stages_dst, VkMemoryBarrier const * memb, uint32_t memb_count, VkBufferMemoryBarrier const * bmemb, uint32_t bmemb_count, VkImageMemoryBarrier const * imemb, uint32_t imemb_count, VkDependencyFlags dep = 0);
 			
 			buffer(pool const & parent, VkCommandBufferLevel lev = VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+			buffer(pool const & parent, VkCommandBuffer handle); //wraps a handle allocated from parent, which keeps ownership of it
 			buffer(buffer const &) = delete;
 			buffer(buffer &&) = delete;
 			~buffer();
 			
 		private:
-
+			bool owned = true;
+		};
+		
+		/*
+			Command buffers for frames in flight, recorded from any number of threads. Each thread gets a TRANSIENT pool of its
+			own per frame, so recording shares neither a pool nor a lock. Buffers are allocated in batches ahead of use and
+			handed out in order; a frame's pools are reset whole once the fence it was submitted with has signaled.
+		*/
+		struct frame_ring {
+			
+			device const & parent;
+			uint32_t const queue_family;
+			
+			//valid until the ring comes back around to the current frame
+			buffer & acquire(VkCommandBufferLevel lev = VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+			
+			/*
+				Ends the current frame, whose buffers were all submitted with frame_done, and begins the next one, waiting for and
+				resetting it if it was used before. No thread may record into the current frame while this runs, and frame_done
+				must not be reset before the ring comes back around.
+			*/
+			void advance(vk::fence const & frame_done);
+			uint32_t frame() const { return current.load(std::memory_order_acquire); }
+			uint32_t frames_in_flight() const { return static_cast<uint32_t>(fences.size()); }
+			
+			/*
+				Records count items into secondary buffers on the job system, one secondary per task and each item in order within
+				it, then executes the secondaries from primary in item order, so the result does not depend on scheduling.
+				Without inheritance the secondaries are recorded for use outside a render pass.
+			*/
+			void record_parallel(job_system & jobs, buffer & primary, size_t count, std::function<void(buffer &, size_t item)> const & record, VkCommandBufferInheritanceInfo const * inheritance = nullptr, size_t grain = 0);
+			
+			frame_ring() = delete;
+			frame_ring(device const & parent, uint32_t queue_family, uint32_t frames_in_flight, uint32_t batch = 8);
+			frame_ring(frame_ring const &) = delete;
+			frame_ring(frame_ring &&) = delete;
+			~frame_ring(); //waits for every frame still in flight
+			
+		private:
+			struct frame_pool {
+				pool cmd_pool;
+				std::vector<std::unique_ptr<buffer>> buffers[2]; //by level
+				size_t used[2] = {0, 0};
+				frame_pool(device const & parent, uint32_t queue_family) : cmd_pool(parent, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT, queue_family) {}
+			};
+			typedef std::vector<std::unique_ptr<frame_pool>> thread_pools; //by frame
+			
+			thread_pools & local();
+			
+			uint64_t const id; //distinguishes rings in the per-thread lookup, addresses may be reused
+			uint32_t const batch;
+			std::atomic<uint32_t> current {0};
+			std::vector<vk::fence const *> fences; //by frame, of its last submission
+			std::vector<std::unique_ptr<thread_pools>> threads;
+			std::mutex mut; //guards threads
 		};
 	}
 	
+//================================================================
+//----------------------------------------------------------------
+//================================================================
+// STATE TRACKING
+	
+	/*
+		Remembers the last writes and the reads since then of every buffer range and image subresource recorded through it,
+		along with image layouts, all in recording order on one queue. Accesses are declared ahead of the command using them
+		and flush() turns the hazards they have with earlier accesses into a single pipeline barrier. Reads that earlier
+		barriers already made the writes visible to need none. Image layouts are kept up to date as the image transitions.
+	*/
+	struct state_tracker {
+		
+		device const & parent;
+		
+		static constexpr VkImageSubresourceRange whole_image = {0, 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS}; //aspects of the format
+		
+		//whether an access writes is taken from its access flags
+		void access(vk::buffer const &, VkPipelineStageFlags stages, VkAccessFlags access, VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE);
+		void access(vk::image &, VkImageLayout layout, VkPipelineStageFlags stages, VkAccessFlags access, VkImageSubresourceRange range = whole_image);
+		
+		void flush(command::buffer &); //records the barrier the accesses declared since the last flush need, if any
+		void dispatch(command::buffer &, uint32_t x, uint32_t y, uint32_t z);
+		void draw(command::buffer &, uint32_t vertex_count, uint32_t instance_count = 1, uint32_t first_vertex = 0, uint32_t first_instance = 0);
+		//declare the indirect argument reads themselves, a pass writing them for the next only needs to declare its writes
+		void dispatch_indirect(command::buffer &, vk::buffer const & args, VkDeviceSize offset = 0);
+		void draw_indirect(command::buffer &, vk::buffer const & args, VkDeviceSize offset, uint32_t draw_count, uint32_t stride = sizeof(VkDrawIndirectCommand));
+		
+		void forget(vk::buffer const &); //before the resource is destroyed
+		void forget(vk::image const &);
+		void reset(); //forgets everything, after the queue has been idle
+		
+		state_tracker() = delete;
+		state_tracker(device const & parent) : parent(parent) {}
+		state_tracker(state_tracker const &) = delete;
+		state_tracker(state_tracker &&) = delete;
+		
+	private:
+		struct access_state {
+			VkPipelineStageFlags write_stages = 0;
+			VkAccessFlags write_access = 0;
+			VkPipelineStageFlags read_stages = 0; //since the last write
+			VkPipelineStageFlags visible_stages = 0; //that the last write has been made visible to
+			VkAccessFlags visible_access = 0;
+			bool operator == (access_state const & o) const { return write_stages == o.write_stages && write_access == o.write_access && read_stages == o.read_stages && visible_stages == o.visible_stages && visible_access == o.visible_access; }
+		};
+		struct buffer_range {
+			VkDeviceSize begin, end;
+			access_state state;
+		};
+		struct subresource {
+			VkImageLayout layout;
+			access_state state;
+		};
+		struct image_state {
+			std::vector<subresource> subresources; //by mip level, then layer
+		};
+		struct pending_access {
+			vk::buffer const * buf;
+			vk::image * img;
+			VkImageLayout layout;
+			VkPipelineStageFlags stages;
+			VkAccessFlags access;
+			VkDeviceSize offset, size;
+			VkImageSubresourceRange range;
+		};
+		
+		static void hazard(access_state const &, VkPipelineStageFlags stages, VkAccessFlags access, bool write, VkPipelineStageFlags & src_stages, VkAccessFlags & src_access);
+		static void apply(access_state &, VkPipelineStageFlags stages, VkAccessFlags access, bool write);
+		void apply(pending_access const &, bool write);
+		image_state & track(vk::image &);
+		void coalesce(size_t first_barrier);
+		
+		std::map<vk::buffer const *, std::vector<buffer_range>> buffers; //disjoint and sorted, gaps have never been accessed
+		std::map<vk::image const *, image_state> images;
+		std::vector<pending_access> pending;
+		
+		//reused between flushes
+		std::vector<std::pair<size_t, uint32_t>> transitioned; //pending access and subresource
+		std::vector<VkImageMemoryBarrier> image_barriers;
+		std::vector<buffer_range> ranges_scratch;
+	};
+	
+//================================================================
+//----------------------------------------------------------------
+//================================================================
+// CHUNKED BUFFER
+	
+	/*
+		A logical buffer spread over as many vk::buffers as it takes, each of at most chunk_size bytes and bound through a
+		memory_heap, so neither maxStorageBufferRange nor the largest single allocation limit its size. Shaders see the
+		chunks as a descriptor array and are told which chunk to work on through push constants.
+	*/
+	struct chunked_buffer {
+		
+		device const & parent;
+		
+		struct span {
+			uint32_t chunk;
+			VkDeviceSize offset; //within the chunk
+			VkDeviceSize size;
+		};
+		
+		//pushed before every dispatch of dispatch(), the shader declares a matching push constant block
+		struct dispatch_constants {
+			uint32_t chunk; //index into the descriptor array
+			uint32_t first; //first element within the chunk
+			uint32_t count; //elements covered by this dispatch, the last workgroup may run past it
+			uint32_t base_low; //logical index of the first element
+			uint32_t base_high;
+		};
+		
+		VkDeviceSize size() const { return size_; }
+		VkDeviceSize chunk_size() const { return chunk_size_; }
+		uint32_t chunk_count() const { return static_cast<uint32_t>(chunks.size()); }
+		vk::buffer & chunk(uint32_t i) { return *chunks[i]; }
+		vk::buffer const & chunk(uint32_t i) const { return *chunks[i]; }
+		
+		span locate(VkDeviceSize offset) const;
+		std::vector<span> split(VkDeviceSize offset, VkDeviceSize size) const; //the pieces of a logical range, in order
+		
+		//one descriptor per chunk, from first to first + count
+		descriptor::buffer_info_set descript(uint32_t first = 0, uint32_t count = UINT32_MAX) const;
+		
+		/*
+			Dispatches one workgroup per local_size elements of element_size bytes over the logical range [first, first + count),
+			at least one dispatch per chunk touched and more where maxComputeWorkGroupCount requires, each preceded by its
+			dispatch_constants at push_offset. The pipeline and its descriptors must already be bound.
+		*/
+		void dispatch(command::buffer & cmd, pipeline::layout const & layout, VkShaderStageFlags stages, uint32_t push_offset, VkDeviceSize element_size, uint32_t local_size, uint64_t first = 0, uint64_t count = UINT64_MAX) const;
+		
+		chunked_buffer() = delete;
+		//a chunk_size of 0 uses the largest that the usage's descriptor range limits allow
+		chunked_buffer(memory_heap & heap, VkDeviceSize size, VkBufferUsageFlags usage, memory_profile profile = memory_profile::gpu_only, VkDeviceSize chunk_size = 0);
+		chunked_buffer(chunked_buffer const &) = delete;
+		chunked_buffer(chunked_buffer &&) = delete;
+		~chunked_buffer() = default;
+		
+	private:
+		VkDeviceSize size_;
+		VkDeviceSize chunk_size_;
+		std::vector<std::unique_ptr<vk::buffer>> chunks;
+	};
+	
+//================================================================
+//----------------------------------------------------------------
+//================================================================
+// PROGRAM
+	
+	/*
+		A command stream recorded once and submitted any number of times. Per submit parameters go into a slice of a
+		persistently mapped parameter buffer; every slot records its own command buffer against its own slice, and a slot is
+		only reused once its previous submit has retired, so patching parameters never races the GPU. Without parameters a
+		single recording with SIMULTANEOUS_USE serves every submit and slots only bound how many are in flight.
+		Recording with a UNIFORM_BUFFER_DYNAMIC or STORAGE_BUFFER_DYNAMIC descriptor lets every slot share one descriptor set.
+	*/
+	struct program {
+		
+		device const & parent;
+		
+		//params is the slot's slice, or empty without parameters; push constants recorded here are fixed for the slot
+		typedef std::function<void(command::buffer &, VkDescriptorBufferInfo const & params, uint32_t slot)> recorder;
+		
+		//copies param_size bytes of params into the next free slot and submits it, waiting for the slot to retire if it must
+		void submit(void const * params = nullptr, VkSemaphore const * wait = nullptr, VkPipelineStageFlags const * wait_stages = nullptr, uint32_t wait_count = 0, VkSemaphore const * signal = nullptr, uint32_t signal_count = 0);
+		void wait(); //for every submit so far
+		
+		uint32_t slots() const { return static_cast<uint32_t>(slots_.size()); }
+		VkDeviceSize param_size() const { return param_size_; }
+		VkDeviceSize param_stride() const { return param_stride_; }
+		vk::buffer const * params_buffer() const { return params.get(); } //null without parameters
+		
+		program() = delete;
+		program(device const & parent, queue_accessor & queue, VkDeviceSize param_size, uint32_t slots, recorder const & record);
+		program(program const &) = delete;
+		program(program &&) = delete;
+		~program(); //waits for every submit
+		
+	private:
+		struct slot {
+			command::buffer * cmd;
+			std::unique_ptr<vk::fence> done;
+			bool pending = false;
+		};
+		
+		queue_accessor & queue;
+		VkDeviceSize param_size_, param_stride_;
+		command::pool pool;
+		std::vector<std::unique_ptr<command::buffer>> recordings; //one per slot, or one shared without parameters
+		std::unique_ptr<vk::buffer> params;
+		std::unique_ptr<vk::memory> params_mem;
+		std::vector<slot> slots_;
+		uint32_t next = 0;
+		std::mutex mut;
+	};
+	
+//================================================================
+//----------------------------------------------------------------
+//================================================================
+// TASK GRAPH
+	
+	/*
+		Compute and transfer work declared as nodes reading and writing whole buffers. compile() orders the nodes by their
+		hazards (in the order they were added) and explicit order() edges, spreads independent nodes over the given
+		queues, and derives what synchronizes them: one pipeline barrier before a node that depends on earlier work of
+		its queue since the last barrier, semaphores between submissions where a dependency crosses queues, and queue
+		family ownership transfers for buffers changing families. A buffer starts out owned by the family of its first user,
+		and is handed back to it at the end of every run, where the next run expects it.
+		The recording is reused by every run, the graph cannot change after compile().
+	*/
+	struct task_graph {
+		
+		device const & parent;
+		typedef uint32_t node_id;
+		
+		node_id dispatch(char const * name, compute_pipeline const &, pipeline::layout const &, std::vector<descriptor::set const *> const & sets, uint32_t x, uint32_t y, uint32_t z, std::vector<vk::buffer const *> const & reads, std::vector<vk::buffer const *> const & writes);
+		node_id copy(char const * name, vk::buffer const & src, vk::buffer & dst, VkBufferCopy const & region);
+		node_id custom(char const * name, device::capability::flags needs, VkPipelineStageFlags stages, VkAccessFlags read_access, VkAccessFlags write_access, std::vector<vk::buffer const *> const & reads, std::vector<vk::buffer const *> const & writes, std::function<void(command::buffer &)> record);
+		void order(node_id before, node_id after); //beyond what the declared accesses imply
+		
+		void compile(); //implied by the first submit
+		void submit(); //waits for the previous run first
+		void wait();
+		void run() { submit(); wait(); }
+		std::string trace() const; //the compiled schedule, by queue and submission
+		
+		task_graph() = delete;
+		task_graph(device const & parent, std::vector<queue_accessor *> const & queues);
+		task_graph(task_graph const &) = delete;
+		task_graph(task_graph &&) = delete;
+		~task_graph(); //waits for the last run
+		
+	private:
+		struct node {
+			std::string name;
+			device::capability::flags needs;
+			VkPipelineStageFlags stages;
+			VkAccessFlags read_access, write_access;
+			std::vector<vk::buffer const *> reads, writes;
+			std::function<void(command::buffer &)> record;
+			std::vector<node_id> after; //predecessors
+			
+			uint32_t queue = 0;
+			uint32_t submission = 0;
+			VkPipelineStageFlags barrier_src = 0; //a barrier before the node when nonzero
+			VkAccessFlags barrier_src_access = 0;
+			std::vector<VkBufferMemoryBarrier> acquire, release; //ownership transfers before and after the node
+		};
+		struct submission {
+			uint32_t queue;
+			std::vector<node_id> nodes;
+			std::vector<uint32_t> waits_on; //submissions, alongside their semaphores
+			std::vector<VkSemaphore> wait_semaphores;
+			std::vector<VkPipelineStageFlags> wait_stages;
+			std::vector<VkSemaphore> signal_semaphores;
+			std::unique_ptr<command::buffer> cmd;
+			std::unique_ptr<vk::fence> done;
+		};
+		
+		node_id add(node &&);
+		uint32_t pick_queue(node const &, std::vector<uint32_t> const & finish, std::vector<uint32_t> const & queue_free) const;
+		
+		std::vector<queue_accessor *> queues;
+		std::vector<node> nodes;
+		std::vector<node_id> topo; //nodes in scheduling order
+		std::vector<submission> submissions; //in submit order
+		std::vector<std::unique_ptr<vk::semaphore>> semaphores;
+		std::map<uint32_t, std::unique_ptr<command::pool>> pools; //by queue family
+		bool compiled = false, pending = false;
+	};
+	
+//================================================================
+//----------------------------------------------------------------
+//================================================================
+// STAGING
+	
+	//a persistently mapped ring of staging memory, uploads are collected and recorded into one command buffer per submit
+	struct staging_ring {
+		
+		device const & parent;
+		
+		struct slice {
+			void * data = nullptr;
+			VkDeviceSize offset = 0; //within the ring buffer
+			VkDeviceSize size = 0;
+			uint64_t position = 0; //of the reservation, monotonic like the ring's head
+		};
+		
+		vk::buffer const & ring_buffer() const {return buf;}
+		VkDeviceSize const & size() const {return size_;}
+		queue_accessor & submit_queue() const {return queue;}
+		
+		//reclaims retired slices, waiting on the oldest submit or submitting pending uploads if the ring is full
+		//a slice keeps its space until it is copied, throws if only slices not yet copied are holding the ring
+		slice reserve(VkDeviceSize size, VkDeviceSize alignment = 16);
+		void copy(slice const &, vk::buffer & dst, VkDeviceSize dst_offset);
+		void copy(slice const &, vk::image & dst, VkImageLayout dst_layout, VkBufferImageCopy region); //region.bufferOffset is relative to the slice
+		void upload(vk::buffer & dst, VkDeviceSize dst_offset, void const * src, VkDeviceSize size);
+		void upload(vk::image & dst, VkImageLayout dst_layout, VkBufferImageCopy const & region, void const * src, VkDeviceSize size);
+		
+		//flushes written slices and submits every pending copy, synchronizing consumers with the copies is up to the caller
+		void submit(VkSemaphore const * signal = nullptr, uint32_t signal_count = 0);
+		void reclaim(); //retires the slices of every signaled submit without blocking
+		
+		staging_ring() = delete;
+		staging_ring(device const & parent, queue_accessor & queue, VkDeviceSize size, uint32_t max_batches = 3);
+		staging_ring(staging_ring const &) = delete;
+		staging_ring(staging_ring &&) = delete;
+		~staging_ring();
+		
+	private:
+		struct buffer_copy {
+			vk::buffer * dst;
+			VkBufferCopy region;
+			size_t sequence; //upload order, kept among copies to the same destination
+		};
+		struct image_copy {
+			vk::image * dst;
+			VkImageLayout layout;
+			VkBufferImageCopy region;
+		};
+		struct batch {
+			std::unique_ptr<command::buffer> cmd;
+			std::unique_ptr<vk::fence> done;
+			uint64_t end = 0;
+		};
+		
+		queue_accessor & queue;
+		VkDeviceSize size_;
+		vk::buffer buf;
+		vk::memory mem;
+		command::pool pool;
+		uint8_t * base;
+		uint64_t head = 0, tail = 0; //monotonic, positions in the ring are these modulo size_
+		std::vector<uint64_t> reserved; //positions of the slices not yet copied, in reserve order; no batch ends past the first
+		std::vector<batch> batches;
+		uint32_t oldest = 0, in_flight = 0;
+		std::vector<buffer_copy> buffer_copies;
+		std::vector<image_copy> image_copies;
+		std::vector<VkBufferCopy> regions_scratch;
+		std::vector<VkBufferImageCopy> image_regions_scratch;
+		
+		void retire_oldest();
+	};
+	
+//================================================================
+//----------------------------------------------------------------
+//================================================================
+// READBACK
+	
+	//copies device data into host cached memory and delivers it from a completion thread once the GPU is done
+	struct readback {
+		
+		device const & parent;
+		
+		//data is only valid during the call; when the read failed, data is null and error holds why
+		typedef std::function<void(void const * data, VkDeviceSize size, std::exception_ptr error)> callback;
+		
+		//sources must be made available to transfer reads by the caller, read() only blocks while the ring is full;
+		//an exception thrown by a callback is rethrown by the next read() or submit()
+		void read(vk::buffer const & src, VkDeviceSize offset, VkDeviceSize size, callback);
+		void read(vk::image const & src, VkImageLayout src_layout, VkBufferImageCopy region, VkDeviceSize size, callback); //region.bufferOffset is ignored
+		std::future<std::vector<uint8_t>> read(vk::buffer const & src, VkDeviceSize offset, VkDeviceSize size);
+		void submit(VkSemaphore const * wait = nullptr, VkPipelineStageFlags const * wait_stages = nullptr, uint32_t wait_count = 0);
+		
+		readback() = delete;
+		readback(device const & parent, queue_accessor & queue, VkDeviceSize size, uint32_t max_batches = 4);
+		readback(readback const &) = delete;
+		readback(readback &&) = delete;
+		~readback(); //submits what is pending and delivers everything in flight
+		
+	private:
+		struct request {
+			VkDeviceSize offset;
+			VkDeviceSize size;
+			callback cb;
+		};
+		struct buffer_copy {
+			vk::buffer const * src;
+			VkBufferCopy region;
+		};
+		struct image_copy {
+			vk::image const * src;
+			VkImageLayout layout;
+			VkBufferImageCopy region;
+		};
+		struct batch {
+			std::unique_ptr<command::buffer> cmd;
+			std::unique_ptr<vk::fence> done;
+			std::vector<request> requests;
+			uint64_t end = 0;
+		};
+		
+		queue_accessor & queue;
+		VkDeviceSize size_;
+		vk::buffer buf;
+		vk::memory mem;
+		command::pool pool;
+		uint8_t const * base;
+		uint64_t head = 0, tail = 0; //monotonic, positions in the ring are these modulo size_
+		std::vector<batch> batches;
+		uint32_t oldest = 0, in_flight = 0;
+		std::vector<request> requests;
+		std::vector<buffer_copy> buffer_copies;
+		std::vector<image_copy> image_copies;
+		std::vector<VkBufferCopy> regions_scratch;
+		bool stopping = false;
+		std::exception_ptr callback_error; //the first thrown by a callback, until rethrown
+		std::mutex mut;
+		std::condition_variable cv_submitted, cv_retired;
+		std::thread completion;
+		
+		VkDeviceSize reserve(std::unique_lock<std::mutex> &, VkDeviceSize size, VkDeviceSize alignment);
+		void submit(std::unique_lock<std::mutex> &, VkSemaphore const * wait, VkPipelineStageFlags const * wait_stages, uint32_t wait_count);
+		void complete();
+		void rethrow_callback_error();
+	};
+	
+//================================================================
+//----------------------------------------------------------------
+//================================================================
+// ALIASING
+	
+	/*
+		Packs transient resources into one allocation by lifetime. Uses are inclusive [first_use, last_use] intervals
+		over caller defined points such as pass indices; resources whose intervals are disjoint may share memory.
+		Resources are placed largest first at the lowest offset not claimed by a resource alive at the same time.
+	*/
+	struct alias_planner {
+		
+		device const & parent;
+		
+		void add(vk::buffer &, uint32_t first_use, uint32_t last_use);
+		void add(vk::image &, uint32_t first_use, uint32_t last_use, VkImageLayout first_layout, VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT);
+		
+		VkDeviceSize plan(); //returns the size of the combined allocation
+		VkDeviceSize planned_size() const {return size_;}
+		VkDeviceSize unaliased_size() const; //what back to back placement would take
+		uint32_t memory_type_bits() const;
+		void bind(vk::memory &); //binds every resource at its planned offset
+		
+		//at the first use of a resource taking over memory from an earlier one: a memory dependency, and images leave UNDEFINED for their first layout, which they are told of
+		void record_barriers(command::buffer &, uint32_t use, VkPipelineStageFlags src_stages = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VkPipelineStageFlags dst_stages = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+		
+		alias_planner() = delete;
+		alias_planner(device const & parent) : parent(parent) {}
+		
+	private:
+		struct entry {
+			memory_bound_structure * res;
+			vk::image * img;
+			VkMemoryRequirements req;
+			uint32_t first_use, last_use;
+			VkImageLayout first_layout;
+			VkImageAspectFlags aspect;
+			VkDeviceSize offset;
+			bool takes_over;
+		};
+		std::vector<entry> entries;
+		std::vector<VkImageMemoryBarrier> image_barriers_scratch; //reused between record_barriers calls
+		VkDeviceSize size_ = 0;
+		bool planned = false;
+	};
+	
 //================================================================
 //----------------------------------------------------------------
 //================================================================
@@ -0,0 +1,115 @@
+#pragma once
+
+#include "vulkanomics.hpp"
+
+#ifndef VULKANOMICS_COROUTINES
+#error "vulkanomics_coro.hpp requires VULKANOMICS_COROUTINES, the library has to be configured with --cxx20"
+#endif
+
+#include <coroutine>
+
+namespace vk {
+	
+//================================================================
+//----------------------------------------------------------------
+//================================================================
+// COROUTINES
+	
+	/*
+		Resumes coroutines once their GPU work finishes. A completion_dispatcher watches the fences of every awaited
+		submission and hands the coroutines to a few worker threads, so any number of suspended coroutines cost no
+		thread each. The executor has to outlive every coroutine suspended on it.
+	*/
+	struct gpu_executor {
+		device const & parent;
+		
+		struct submit_awaiter {
+			gpu_executor & exec;
+			queue_accessor & queue;
+			VkSubmitInfo * infos;
+			uint32_t infos_count;
+			VkResult result = VK_SUCCESS;
+			bool await_ready() const noexcept {return false;}
+			void await_suspend(std::coroutine_handle<>);
+			void await_resume() const;
+		};
+		
+		struct upload_awaiter {
+			gpu_executor & exec;
+			staging_ring & ring;
+			VkSemaphore uploaded = VK_NULL_HANDLE;
+			VkResult result = VK_SUCCESS;
+			bool await_ready() const noexcept {return false;}
+			void await_suspend(std::coroutine_handle<>);
+			void await_resume() const;
+		};
+		
+		struct read_awaiter {
+			gpu_executor & exec;
+			readback & rb;
+			vk::buffer const & src;
+			VkDeviceSize offset, size;
+			bool submit;
+			std::vector<uint8_t> data;
+			std::exception_ptr error;
+			bool await_ready() const noexcept {return false;}
+			void await_suspend(std::coroutine_handle<>);
+			std::vector<uint8_t> await_resume();
+		};
+		
+		struct schedule_awaiter {
+			gpu_executor & exec;
+			bool await_ready() const noexcept {return false;}
+			void await_suspend(std::coroutine_handle<> h) {exec.post(h);}
+			void await_resume() const noexcept {}
+		};
+		
+		//resumes once the infos have executed, the infos have to stay valid until then
+		submit_awaiter submit(queue_accessor & queue, VkSubmitInfo * infos, uint32_t infos_count) {return {*this, queue, infos, infos_count};}
+		//submits every pending upload of the ring and resumes once they are done
+		upload_awaiter upload(staging_ring & ring) {return {*this, ring};}
+		//resumes with the data once read, submitting the readback right away unless other reads should join its batch
+		read_awaiter read(readback & rb, vk::buffer const & src, VkDeviceSize offset, VkDeviceSize size, bool submit = true) {return {*this, rb, src, offset, size, submit, {}, {}};}
+		//continues on a worker thread of the executor
+		schedule_awaiter schedule() {return {*this};}
+		
+		void post(std::coroutine_handle<>);
+		
+		gpu_executor() = delete;
+		gpu_executor(device const & parent, uint32_t workers = 1, std::chrono::microseconds poll_interval = std::chrono::microseconds {1000});
+		gpu_executor(gpu_executor const &) = delete;
+		gpu_executor(gpu_executor &&) = delete;
+		~gpu_executor(); //waits for the work in flight, coroutines it would resume are left suspended
+		
+	private:
+		VkSemaphore acquire_semaphore();
+		void release_semaphore(VkSemaphore);
+		void work();
+		
+		fence_pool fences;
+		std::vector<std::unique_ptr<vk::semaphore>> semaphores;
+		std::vector<VkSemaphore> available_semaphores;
+		std::deque<std::coroutine_handle<>> ready;
+		bool stopping = false;
+		std::mutex mut;
+		std::condition_variable cv;
+		std::vector<std::thread> threads;
+		completion_dispatcher dispatcher; //last, stopped before anything it calls into
+	};
+	
+	//a coroutine started right away and destroyed once it finishes, for request handlers nobody awaits
+	struct detached_task {
+		struct promise_type {
+			detached_task get_return_object() noexcept {return {};}
+			std::suspend_never initial_suspend() noexcept {return {};}
+			std::suspend_never final_suspend() noexcept {return {};}
+			void return_void() noexcept {}
+			void unhandled_exception() noexcept {std::terminate();}
+		};
+	};
+	
+//================================================================
+//----------------------------------------------------------------
+//================================================================
+	
+}
@@ -6,7 +6,9 @@
 #define VK_GLOBAL_PROC( func ) PFN_vk##func vk::func = nullptr;
 #define VK_INSTANCE_PROC( func ) PFN_vk##func vk::func = nullptr;
 #define VK_SURFACE_PROC( func ) PFN_vk##func vk::func = nullptr;
+#define VK_INSTANCE_EXT_PROC( func ) PFN_vk##func vk::func = nullptr;
 #define VK_DEVICE_PROC( func )
+#define VK_DEVICE_EXT_PROC( func )
 #define VK_SWAPCHAIN_PROC( func )
 
 #endif
@@ -18,7 +20,9 @@
 #define VK_GLOBAL_PROC( func ) extern PFN_vk##func func;
 #define VK_INSTANCE_PROC( func ) extern PFN_vk##func func;
 #define VK_SURFACE_PROC( func ) extern PFN_vk##func func;
+#define VK_INSTANCE_EXT_PROC( func ) extern PFN_vk##func func;
 #define VK_DEVICE_PROC( func )
+#define VK_DEVICE_EXT_PROC( func )
 #define VK_SWAPCHAIN_PROC( func )
 
 #endif
@@ -30,7 +34,9 @@
 #define VK_GLOBAL_PROC( func )
 #define VK_INSTANCE_PROC( func )
 #define VK_SURFACE_PROC( func )
+#define VK_INSTANCE_EXT_PROC( func )
 #define VK_DEVICE_PROC( func ) PFN_vk##func vk##func;
+#define VK_DEVICE_EXT_PROC( func ) PFN_vk##func vk##func = nullptr;
 #define VK_SWAPCHAIN_PROC( func ) PFN_vk##func vk##func;
 
 #endif
@@ -42,7 +48,9 @@
 #define VK_GLOBAL_PROC( func ) vk::func = (PFN_vk##func)vk::GetInstanceProcAddr(NULL, "vk"#func); if (!vk::func) srcthrow("could not acquire required instance level function vk"#func" from vkGetInstanceProcAddr");
 #define VK_INSTANCE_PROC( func )
 #define VK_SURFACE_PROC( func )
+#define VK_INSTANCE_EXT_PROC( func )
 #define VK_DEVICE_PROC( func )
+#define VK_DEVICE_EXT_PROC( func )
 #define VK_SWAPCHAIN_PROC( func )
 
 #endif
@@ -54,7 +62,9 @@
 #define VK_GLOBAL_PROC( func )
 #define VK_INSTANCE_PROC( func ) vk::func = (PFN_vk##func)vk::GetInstanceProcAddr(vk_instance, "vk"#func); if (!vk::func) srcthrow("could not acquire required instance level function vk"#func" from vkGetInstanceProcAddr");
 #define VK_SURFACE_PROC( func )
+#define VK_INSTANCE_EXT_PROC( func ) vk::func = (PFN_vk##func)vk::GetInstanceProcAddr(vk_instance, "vk"#func);
 #define VK_DEVICE_PROC( func )
+#define VK_DEVICE_EXT_PROC( func )
 #define VK_SWAPCHAIN_PROC( func )
 
 #endif
@@ -66,7 +76,9 @@
 #define VK_GLOBAL_PROC( func )
 #define VK_INSTANCE_PROC( func ) 
 #define VK_SURFACE_PROC( func ) vk::func = (PFN_vk##func)vk::GetInstanceProcAddr(vk_instance, "vk"#func); if (!vk::func) srcthrow("could not acquire required instance level function vk"#func" from vkGetInstanceProcAddr");
+#define VK_INSTANCE_EXT_PROC( func )
 #define VK_DEVICE_PROC( func )
+#define VK_DEVICE_EXT_PROC( func )
 #define VK_SWAPCHAIN_PROC( func )
 
 #endif
@@ -78,7 +90,9 @@
 #define VK_GLOBAL_PROC( func )
 #define VK_INSTANCE_PROC( func )
 #define VK_SURFACE_PROC( func )
+#define VK_INSTANCE_EXT_PROC( func )
 #define VK_DEVICE_PROC( func ) this->vk##func = (PFN_vk##func)vk::GetDeviceProcAddr(handle, "vk"#func); if (!this->vk##func) srcthrow("could not acquire required instance level function vk"#func" from vkGetInstanceProcAddr");
+#define VK_DEVICE_EXT_PROC( func ) this->vk##func = (PFN_vk##func)vk::GetDeviceProcAddr(handle, "vk"#func);
 #define VK_SWAPCHAIN_PROC( func )
 
 #endif
@@ -90,7 +104,9 @@
 #define VK_GLOBAL_PROC( func )
 #define VK_INSTANCE_PROC( func )
 #define VK_SURFACE_PROC( func )
+#define VK_INSTANCE_EXT_PROC( func )
 #define VK_DEVICE_PROC( func ) 
+#define VK_DEVICE_EXT_PROC( func )
 #define VK_SWAPCHAIN_PROC( func ) this->vk##func = (PFN_vk##func)vk::GetDeviceProcAddr(handle, "vk"#func); if (!this->vk##func) srcthrow("could not acquire required instance level function vk"#func" from vkGetInstanceProcAddr");
 
 #endif
@@ -128,6 +144,12 @@ VK_SURFACE_PROC( GetPhysicalDeviceSurfaceFormatsKHR )
 VK_SURFACE_PROC( GetPhysicalDeviceSurfacePresentModesKHR )
 VK_SURFACE_PROC( CreateXcbSurfaceKHR )
 
+//Optional instance extensions, null when unsupported
+#ifdef VK_KHR_get_physical_device_properties2
+VK_INSTANCE_EXT_PROC( GetPhysicalDeviceMemoryProperties2KHR )
+VK_INSTANCE_EXT_PROC( GetPhysicalDeviceFeatures2KHR )
+#endif
+
 //Debug Extension
 #ifdef PROGENY_VK_DEBUG
 VK_INSTANCE_PROC( CreateDebugReportCallbackEXT )
@@ -144,6 +166,7 @@ VK_DEVICE_PROC( DestroyDevice )
 VK_DEVICE_PROC( DeviceWaitIdle )
 VK_DEVICE_PROC( CreateCommandPool )
 VK_DEVICE_PROC( AllocateCommandBuffers )
+VK_DEVICE_PROC( ResetCommandPool )
 VK_DEVICE_PROC( BeginCommandBuffer )
 VK_DEVICE_PROC( CmdPipelineBarrier )
 VK_DEVICE_PROC( CmdClearColorImage )
@@ -171,8 +194,18 @@ VK_DEVICE_PROC( CmdEndRenderPass )
 VK_DEVICE_PROC( CmdBindPipeline )
 VK_DEVICE_PROC( CmdDraw )
 VK_DEVICE_PROC( CmdDispatch )
+VK_DEVICE_PROC( CmdDispatchIndirect )
+VK_DEVICE_PROC( CmdDrawIndirect )
+VK_DEVICE_PROC( CmdDrawIndexedIndirect )
+VK_DEVICE_PROC( CmdBindIndexBuffer )
+VK_DEVICE_PROC( CmdFillBuffer )
+VK_DEVICE_PROC( CmdPushConstants )
+VK_DEVICE_PROC( CmdExecuteCommands )
 VK_DEVICE_PROC( CreateImage )
 VK_DEVICE_PROC( CmdCopyImage )
+VK_DEVICE_PROC( CmdCopyBuffer )
+VK_DEVICE_PROC( CmdCopyBufferToImage )
+VK_DEVICE_PROC( CmdCopyImageToBuffer )
 VK_DEVICE_PROC( DestroyImage )
 VK_DEVICE_PROC( GetImageMemoryRequirements )
 VK_DEVICE_PROC( AllocateMemory )
@@ -188,8 +221,10 @@ VK_DEVICE_PROC( CmdBindVertexBuffers )
 VK_DEVICE_PROC( CreateFence )
 VK_DEVICE_PROC( DestroyFence )
 VK_DEVICE_PROC( ResetFences )
+VK_DEVICE_PROC( GetFenceStatus )
 VK_DEVICE_PROC( WaitForFences )
 VK_DEVICE_PROC( FlushMappedMemoryRanges )
+VK_DEVICE_PROC( InvalidateMappedMemoryRanges )
 VK_DEVICE_PROC( CmdSetViewport )
 VK_DEVICE_PROC( CmdSetScissor )
 VK_DEVICE_PROC( QueueWaitIdle )
@@ -202,6 +237,25 @@ VK_DEVICE_PROC( FreeDescriptorSets )
 VK_DEVICE_PROC( UpdateDescriptorSets )
 VK_DEVICE_PROC( CmdBindDescriptorSets )
 
+//Optional device extensions, null unless enabled on the device
+#ifdef VK_KHR_get_memory_requirements2
+VK_DEVICE_EXT_PROC( GetBufferMemoryRequirements2KHR )
+VK_DEVICE_EXT_PROC( GetImageMemoryRequirements2KHR )
+#endif
+#ifdef VK_KHR_bind_memory2
+VK_DEVICE_EXT_PROC( BindBufferMemory2KHR )
+VK_DEVICE_EXT_PROC( BindImageMemory2KHR )
+#endif
+#ifdef VK_KHR_draw_indirect_count
+VK_DEVICE_EXT_PROC( CmdDrawIndirectCountKHR )
+VK_DEVICE_EXT_PROC( CmdDrawIndexedIndirectCountKHR )
+#endif
+#ifdef VK_KHR_timeline_semaphore
+VK_DEVICE_EXT_PROC( GetSemaphoreCounterValueKHR )
+VK_DEVICE_EXT_PROC( WaitSemaphoresKHR )
+VK_DEVICE_EXT_PROC( SignalSemaphoreKHR )
+#endif
+
 //Swapchain Extension
 VK_SWAPCHAIN_PROC( CreateSwapchainKHR )
 VK_SWAPCHAIN_PROC( DestroySwapchainKHR )
@@ -217,5 +271,7 @@ VK_SWAPCHAIN_PROC( QueuePresentKHR )
 #undef VK_GLOBAL_PROC
 #undef VK_INSTANCE_PROC
 #undef VK_SURFACE_PROC
+#undef VK_INSTANCE_EXT_PROC
 #undef VK_DEVICE_PROC
+#undef VK_DEVICE_EXT_PROC
 #undef VK_SWAPCHAIN_PROC